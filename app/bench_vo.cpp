@@ -0,0 +1,464 @@
+/*
+ * Benchmark of the RGBD VO system: replays a sequence headless with deterministic
+ * settings, then runs the micro-benchmarks, and writes one JSON report with the
+ * stage latencies, the throughput, the peak RSS and the ATE / RPE
+ */
+#include <sys/resource.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <Eigen/Geometry>
+#include <opencv2/core.hpp>
+#include "myslam/config.h"
+#include "myslam/frontend.h"
+#include "myslam/map.h"
+#include "myslam/backend.h"
+#include "myslam/frame.h"
+#include "myslam/frame_loader.h"
+#include "myslam/profiler.h"
+#include "myslam/hamming.h"
+#include "myslam/pnp_ransac.h"
+#include "myslam/pose_optimizer.h"
+#include "myslam/local_ba.h"
+#include "myslam/util.h"
+#include "myslam/task_scheduler.h"
+
+namespace {
+
+typedef myslam::Map::StampedPose StampedPose;
+typedef myslam::Map::Trajectory Trajectory;
+typedef std::chrono::steady_clock Clock;
+
+double elapsedMs(const Clock::time_point& start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+struct LatencyStats {
+    size_t count;
+    double mean, p50, p90, p99, max;
+};
+
+// nearest rank percentiles
+LatencyStats computeStats(vector<double> samples) {
+    LatencyStats stats = {samples.size(), 0, 0, 0, 0, 0};
+    if (samples.empty()) {
+        return stats;
+    }
+    sort(samples.begin(), samples.end());
+    auto percentile = [&samples](double p) {
+        size_t rank = size_t(std::ceil(p * samples.size()));
+        return samples[min(max<size_t>(rank, 1), samples.size()) - 1];
+    };
+    for (double s : samples) {
+        stats.mean += s;
+    }
+    stats.mean /= samples.size();
+    stats.p50 = percentile(0.5);
+    stats.p90 = percentile(0.9);
+    stats.p99 = percentile(0.99);
+    stats.max = samples.back();
+    return stats;
+}
+
+void writeStats(ostream& out, const LatencyStats& stats) {
+    out << "{\"count\": " << stats.count << ", \"mean_ms\": " << stats.mean
+        << ", \"p50_ms\": " << stats.p50 << ", \"p90_ms\": " << stats.p90
+        << ", \"p99_ms\": " << stats.p99 << ", \"max_ms\": " << stats.max << "}";
+}
+
+// TUM groundtruth file: timestamp tx ty tz qx qy qz qw of T_w_c
+bool readGroundTruth(const string& path, std::map<double, SE3>& groundTruth) {
+    ifstream fin(path);
+    if (!fin) {
+        return false;
+    }
+    string line;
+    while (getline(fin, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        istringstream iss(line);
+        double t, tx, ty, tz, qx, qy, qz, qw;
+        if (iss >> t >> tx >> ty >> tz >> qx >> qy >> qz >> qw) {
+            groundTruth[t] = SE3(Eigen::Quaterniond(qw, qx, qy, qz).normalized(), Vector3d(tx, ty, tz));
+        }
+    }
+    return !groundTruth.empty();
+}
+
+/*
+  Pairs of estimated and groundtruth T_w_c, sorted by time, with the closest
+  groundtruth within maxDifference seconds as in tools/associate.py
+*/
+void associate(const Trajectory& trajectory, const std::map<double, SE3>& groundTruth,
+               vector<SE3>& estimated, vector<SE3>& reference, const double maxDifference = 0.02) {
+    Trajectory sorted = trajectory;
+    sort(sorted.begin(), sorted.end(),
+         [](const StampedPose& a, const StampedPose& b) { return a.first < b.first; });
+    for (auto& stampedPose : sorted) {
+        auto after = groundTruth.lower_bound(stampedPose.first);
+        auto best = groundTruth.end();
+        if (after != groundTruth.end()) {
+            best = after;
+        }
+        if (after != groundTruth.begin()) {
+            auto before = std::prev(after);
+            if (best == groundTruth.end() || stampedPose.first - before->first < best->first - stampedPose.first) {
+                best = before;
+            }
+        }
+        if (best == groundTruth.end() || std::abs(best->first - stampedPose.first) > maxDifference) {
+            continue;
+        }
+        estimated.push_back(stampedPose.second.inverse());
+        reference.push_back(best->second);
+    }
+}
+
+// ATE after the rigid alignment of the positions (Horn), and RPE between consecutive poses, as the TUM tools
+void writeTrajectoryError(ostream& out, const Trajectory& trajectory, const std::map<double, SE3>& groundTruth) {
+    vector<SE3> estimated, reference;
+    associate(trajectory, groundTruth, estimated, reference);
+    const size_t n = estimated.size();
+    if (n < 3) {
+        out << "{\"pairs\": " << n << "}";
+        return;
+    }
+
+    Eigen::Matrix3Xd src(3, n), dst(3, n);
+    for (size_t i = 0; i < n; i++) {
+        src.col(i) = estimated[i].translation();
+        dst.col(i) = reference[i].translation();
+    }
+    const Eigen::Matrix4d alignment = Eigen::umeyama(src, dst, false);
+    vector<double> errors(n);
+    double ateSum2 = 0;
+    for (size_t i = 0; i < n; i++) {
+        const Vector3d aligned = alignment.topLeftCorner<3, 3>() * src.col(i) + alignment.topRightCorner<3, 1>();
+        errors[i] = (aligned - dst.col(i)).norm();
+        ateSum2 += errors[i] * errors[i];
+    }
+    sort(errors.begin(), errors.end());
+
+    double transSum2 = 0, rotSum2 = 0;
+    for (size_t i = 0; i + 1 < n; i++) {
+        const SE3 error = (reference[i].inverse() * reference[i + 1]).inverse() * (estimated[i].inverse() * estimated[i + 1]);
+        const double rot = error.so3().log().norm() * 180.0 / M_PI;
+        transSum2 += error.translation().squaredNorm();
+        rotSum2 += rot * rot;
+    }
+
+    out << "{\"pairs\": " << n
+        << ", \"ate_rmse_m\": " << sqrt(ateSum2 / n) << ", \"ate_median_m\": " << errors[n / 2]
+        << ", \"ate_max_m\": " << errors.back()
+        << ", \"rpe_trans_rmse_m\": " << sqrt(transSum2 / (n - 1))
+        << ", \"rpe_rot_rmse_deg\": " << sqrt(rotSum2 / (n - 1)) << "}";
+}
+
+// the parameters the results depend on, compare_bench.py refuses to compare reports that differ
+void writeSettings(ostream& out) {
+    static const char* INT_KEYS[] = {
+        "tracking_mode", "pipelined_tracking", "pipeline_depth", "scheduler_threads",
+        "scheduler_max_background", "number_of_features", "level_pyramid", "grid_extraction",
+        "guided_matching", "motion_model", "enable_local_optimization", "incremental_ba", "bench_seed"
+    };
+    out << "  \"settings\": {\"latency_control\": 0";
+    for (const char* key : INT_KEYS) {
+        out << ", \"" << key << "\": " << myslam::Config::get<int>(key);
+    }
+    out << ", \"scheduler_workers\": " << myslam::TaskScheduler::getInstance().getNumWorkers() << "},\n";
+}
+
+// best match of random ORB-like descriptors, the same as the brute-force matching of the frontend
+void benchMatching(ostream& out, cv::RNG& rng, const int repetitions) {
+    Mat query(1000, myslam::DescriptorPool::DESCRIPTOR_SIZE, CV_8U), train(500, myslam::DescriptorPool::DESCRIPTOR_SIZE, CV_8U);
+    rng.fill(query, cv::RNG::UNIFORM, 0, 256);
+    rng.fill(train, cv::RNG::UNIFORM, 0, 256);
+
+    vector<double> samples;
+    long distanceSum = 0;
+    for (int r = 0; r < repetitions; r++) {
+        auto start = Clock::now();
+        for (int i = 0; i < query.rows; i++) {
+            int bestDist, secondDist;
+            myslam::searchBestMatch(query.ptr<uchar>(i), train.ptr<uchar>(0), train.step, train.rows, bestDist, secondDist);
+            distanceSum += bestDist;
+        }
+        samples.push_back(elapsedMs(start));
+    }
+    out << "{\"queries\": " << query.rows << ", \"train\": " << train.rows
+        << ", \"mean_best_distance\": " << double(distanceSum) / (repetitions * query.rows) << ", \"latency\": ";
+    writeStats(out, computeStats(samples));
+    out << "}";
+}
+
+// PnPRansac and PoseOptimizer on synthetic correspondences with noise and outliers
+void benchPnP(ostream& out, cv::RNG& rng, const myslam::Camera::Ptr& camera, const int repetitions) {
+    const int n = 300;
+    const double outlierRatio = 0.3;
+    myslam::PnPRansac pnpRansac;
+    myslam::PoseOptimizer poseOptimizer;
+    myslam::PoseCorrespondences corr;
+    vector<uchar> inliers;
+
+    vector<double> samples;
+    double rotSum2 = 0, transSum2 = 0;
+    for (int r = 0; r < repetitions; r++) {
+        Sophus::Vector6d xi;
+        xi << rng.uniform(-0.5, 0.5), rng.uniform(-0.5, 0.5), rng.uniform(-0.5, 0.5),
+              rng.uniform(-0.3, 0.3), rng.uniform(-0.3, 0.3), rng.uniform(-0.3, 0.3);
+        const SE3 T_c_w = SE3::exp(xi);
+
+        corr.clear();
+        for (int i = 0; i < n; i++) {
+            const Vector3d p_c(rng.uniform(-2.0, 2.0), rng.uniform(-1.5, 1.5), rng.uniform(1.0, 5.0));
+            Vector2d pixel = camera->camera2pixel(p_c);
+            if (rng.uniform(0.0, 1.0) < outlierRatio) {
+                pixel = Vector2d(rng.uniform(0.0, 640.0), rng.uniform(0.0, 480.0));
+            } else {
+                pixel += Vector2d(rng.gaussian(1.0), rng.gaussian(1.0));
+            }
+            corr.add(T_c_w.inverse() * p_c, cv::Point2f(pixel[0], pixel[1]));
+        }
+
+        // the prior is off by a few centimeters and degrees, as a motion model prediction
+        Sophus::Vector6d noise;
+        noise << rng.gaussian(0.05), rng.gaussian(0.05), rng.gaussian(0.05),
+                 rng.gaussian(0.03), rng.gaussian(0.03), rng.gaussian(0.03);
+        const SE3 prior = SE3::exp(noise) * T_c_w;
+
+        SE3 pose;
+        auto start = Clock::now();
+        if (pnpRansac.estimate(corr, camera, prior, pose, inliers) > 0) {
+            poseOptimizer.optimize(corr, camera, pose, inliers);
+        }
+        samples.push_back(elapsedMs(start));
+
+        const SE3 error = pose * T_c_w.inverse();
+        const double rot = error.so3().log().norm() * 180.0 / M_PI;
+        rotSum2 += rot * rot;
+        transSum2 += (pose.inverse().translation() - T_c_w.inverse().translation()).squaredNorm();
+    }
+    out << "{\"correspondences\": " << n << ", \"outlier_ratio\": " << outlierRatio
+        << ", \"rot_rmse_deg\": " << sqrt(rotSum2 / repetitions)
+        << ", \"trans_rmse_m\": " << sqrt(transSum2 / repetitions) << ", \"latency\": ";
+    writeStats(out, computeStats(samples));
+    out << "}";
+}
+
+// linear triangulation of synthetic points seen by a few keyframes, as triangulateActiveMapPoints
+void benchTriangulation(ostream& out, cv::RNG& rng, const myslam::Camera::Ptr& camera, const int repetitions) {
+    const int n = 1000, views = 5;
+    vector<Mat34, Eigen::aligned_allocator<Mat34>> poses;
+    for (int k = 0; k < views; k++) {
+        poses.push_back(SE3(SO3::exp(Vector3d(0, 0.02 * k, 0)), Vector3d(-0.1 * k, 0, 0)).matrix3x4());
+    }
+
+    vector<double> samples;
+    double sum2 = 0;
+    int triangulated = 0;
+    for (int r = 0; r < repetitions; r++) {
+        vector<Vec3, Eigen::aligned_allocator<Vec3>> points(n), observations(n * views);
+        for (int i = 0; i < n; i++) {
+            points[i] = Vec3(rng.uniform(-2.0, 2.0), rng.uniform(-1.5, 1.5), rng.uniform(1.0, 5.0));
+            for (int k = 0; k < views; k++) {
+                const Vec3 p_c = poses[k] * points[i].homogeneous();
+                observations[i * views + k] = Vec3(p_c[0] / p_c[2] + rng.gaussian(1.0 / camera->fx_),
+                                                   p_c[1] / p_c[2] + rng.gaussian(1.0 / camera->fy_), 1);
+            }
+        }
+
+        vector<Vec3, Eigen::aligned_allocator<Vec3>> results(n);
+        vector<uchar> success(n);
+        auto start = Clock::now();
+        for (int i = 0; i < n; i++) {
+            Eigen::Matrix4d AtA = Eigen::Matrix4d::Zero();
+            for (int k = 0; k < views; k++) {
+                myslam::addTriangulationObservation(poses[k], observations[i * views + k], AtA);
+            }
+            success[i] = myslam::triangulationFromNormal(AtA, results[i]);
+        }
+        samples.push_back(elapsedMs(start));
+
+        for (int i = 0; i < n; i++) {
+            if (success[i]) {
+                sum2 += (results[i] - points[i]).squaredNorm();
+                triangulated++;
+            }
+        }
+    }
+    out << "{\"points\": " << n << ", \"views\": " << views
+        << ", \"success_ratio\": " << double(triangulated) / (n * repetitions)
+        << ", \"rmse_m\": " << (triangulated > 0 ? sqrt(sum2 / triangulated) : 0.0) << ", \"latency\": ";
+    writeStats(out, computeStats(samples));
+    out << "}";
+}
+
+// local BA over the last keyframes of the replayed map, the graph is rebuilt for every repetition
+void benchBackendOptimize(ostream& out, const myslam::Map::Ptr& map, const myslam::Camera::Ptr& camera,
+                          const int window, const int repetitions) {
+    vector<unsigned long> ids;
+    for (auto& kf : *map->getAllKeyFrames()) {
+        ids.push_back(kf.first);
+    }
+    sort(ids.begin(), ids.end());
+    unordered_set<unsigned long> windowIds(ids.end() - min<size_t>(ids.size(), window), ids.end());
+
+    vector<double> samples;
+    if (windowIds.size() >= 2) {
+        myslam::LocalBundleAdjustment localBA(map, camera, myslam::Config::get<float>("chi2_th"), false);
+        vector<myslam::Frame::Ptr> updatedKeyFrames;
+        vector<myslam::MapPoint::Ptr> updatedMapPoints;
+        for (int r = 0; r < repetitions; r++) {
+            auto start = Clock::now();
+            localBA.setWindow(windowIds);
+            localBA.optimize(updatedKeyFrames, updatedMapPoints);
+            samples.push_back(elapsedMs(start));
+        }
+    }
+    out << "{\"keyframes\": " << windowIds.size() << ", \"latency\": ";
+    writeStats(out, computeStats(samples));
+    out << "}";
+}
+
+} // namespace
+
+int main ( int argc, char** argv )
+{
+    if ( argc < 2 || argc > 4 )
+    {
+        cout<<"usage: bench_vo parameter_file [dataset_dir] [report_file]"<<endl;
+        return 1;
+    }
+
+    myslam::Config::setParameterFile ( argv[1] );
+
+    string dataset_dir = argc > 2 ? argv[2] : myslam::Config::get<string> ( "dataset_dir" );
+    string report_file = argc > 3 ? argv[3] : myslam::Config::get<string> ( "bench_report_file" );
+    const int repetitions = max(1, myslam::Config::get<int> ( "bench_repetitions" ));
+    cout<<"Path of dataset: "<<dataset_dir<<endl;
+
+    // deterministic settings: fixed seeds, no viewer, no latency control, and the frontend waits
+    // for the backend after each keyframe so the results do not depend on the thread timing
+    cv::setRNGSeed ( myslam::Config::get<int> ( "bench_seed" ) );
+
+    myslam::Camera::Ptr camera ( new myslam::Camera );
+    myslam::Map::Ptr map ( new myslam::Map );
+    myslam::FrameLoader::Ptr loader ( new myslam::FrameLoader ( dataset_dir, camera ) );
+    if ( !loader->isOpened() )
+    {
+        cout<<"please generate the associate file called associate.txt!"<<endl;
+        return 1;
+    }
+
+    myslam::FrontEnd::Ptr frontend ( new myslam::FrontEnd ( map ) );
+    frontend->setBackendSync(true);
+    frontend->setLatencyControl(false);
+    myslam::Backend::Ptr backend;
+    if (myslam::Config::get<int> ( "enable_local_optimization" )) {
+        backend = myslam::Backend::Ptr(new myslam::Backend(map));
+        backend->setCamera(camera);
+        frontend->setBackend(backend);
+    }
+
+    myslam::Profiler::getInstance().keepStageTimes(true);
+    myslam::Profiler::getInstance().open(myslam::Config::get<string> ( "profile_file" ), "");
+
+    myslam::FeatureExtractor::Ptr extractor = frontend->getFeatureExtractor();
+    if (myslam::Config::get<int> ( "pipelined_tracking" ) && frontend->extractsEveryFrame()) {
+        extractor->start([&loader] { return loader->next(); });
+    }
+
+    // replay, the poses of the tracked frames are kept as they were estimated
+    Trajectory trackedPoses;
+    size_t frames = 0;
+    bool lost = false;
+    auto replayStart = Clock::now();
+    while ( true )
+    {
+        myslam::Frame::Ptr pFrame = extractor->isPipelined() ? extractor->next() : loader->next();
+        if ( pFrame == nullptr )
+            break;
+        frames++;
+
+        myslam::Profiler::getInstance().beginFrame(pFrame->getId());
+        bool tracked = frontend->addFrame ( pFrame );
+        myslam::Profiler::getInstance().endFrame();
+        if ( tracked && frontend->getState() == myslam::FrontEnd::TRACKING ) {
+            trackedPoses.push_back(make_pair(pFrame->time_stamp_, pFrame->getPose()));
+        }
+        if ( frontend->getState() == myslam::FrontEnd::LOST ) {
+            lost = true;
+            break;
+        }
+    }
+    const double replaySeconds = elapsedMs(replayStart) / 1000.0;
+
+    extractor->Stop();
+    loader->Stop();
+    if (backend) {
+        backend->Stop();
+    }
+    myslam::Profiler::getInstance().close();
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    ostringstream report;
+    report << std::setprecision(6);
+    report << "{\n";
+    report << "  \"sequence\": \"" << dataset_dir << "\",\n";
+    report << "  \"frames\": " << frames << ",\n";
+    report << "  \"tracked_frames\": " << trackedPoses.size() << ",\n";
+    report << "  \"keyframes\": " << map->getTrajectory().size() << ",\n";
+    report << "  \"lost\": " << (lost ? "true" : "false") << ",\n";
+    report << "  \"wall_time_s\": " << replaySeconds << ",\n";
+    report << "  \"throughput_fps\": " << (replaySeconds > 0 ? frames / replaySeconds : 0.0) << ",\n";
+    // kilobytes on Linux
+    report << "  \"peak_rss_mb\": " << usage.ru_maxrss / 1024.0 << ",\n";
+    writeSettings(report);
+
+    report << "  \"stages\": {";
+    for (int i = 0; i < myslam::Profiler::NUM_STAGES; i++) {
+        myslam::Profiler::Stage stage = myslam::Profiler::Stage(i);
+        report << (i ? "," : "") << "\n    \"" << myslam::Profiler::getStageName(stage) << "\": ";
+        writeStats(report, computeStats(myslam::Profiler::getInstance().getStageTimes(stage)));
+    }
+    report << "\n  },\n";
+
+    // the tracked poses as estimated online, and the keyframes after the backend
+    std::map<double, SE3> groundTruth;
+    if (readGroundTruth(dataset_dir + "/" + myslam::Config::get<string> ( "groundtruth_file" ), groundTruth)) {
+        report << "  \"trajectory_error\": ";
+        writeTrajectoryError(report, trackedPoses, groundTruth);
+        report << ",\n  \"keyframe_trajectory_error\": ";
+        writeTrajectoryError(report, map->getTrajectory(), groundTruth);
+        report << ",\n";
+    } else {
+        cout << "No groundtruth in " << dataset_dir << ", the trajectory error is skipped" << endl;
+    }
+
+    // after the evaluation, the backend benchmark writes into the map
+    cv::RNG rng ( myslam::Config::get<int> ( "bench_seed" ) );
+    report << "  \"micro\": {\n    \"matching\": ";
+    benchMatching(report, rng, repetitions);
+    report << ",\n    \"pnp\": ";
+    benchPnP(report, rng, camera, repetitions);
+    report << ",\n    \"triangulation\": ";
+    benchTriangulation(report, rng, camera, repetitions);
+    report << ",\n    \"backend_optimize\": ";
+    benchBackendOptimize(report, map, camera, myslam::Config::get<int> ( "bench_ba_window" ), repetitions);
+    report << "\n  }\n}\n";
+
+    cout << report.str();
+    ofstream fout ( report_file );
+    if ( !fout ) {
+        cout << "Cannot open the report file " << report_file << endl;
+        return 1;
+    }
+    fout << report.str();
+    return 0;
+}
@@ -0,0 +1,78 @@
+/*
+ * Run several sequences in one process, one VO session per sequence on its own thread
+ */
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include "myslam/config.h"
+#include "myslam/camera.h"
+#include "myslam/session.h"
+
+void writePosetoFile(ofstream& outputFile, const string& timestamp, const SE3& pose) {
+    Vector3d translation = pose.translation();
+    Eigen::Quaterniond rotation = Eigen::Quaterniond(pose.rotationMatrix());
+    outputFile << timestamp << ' ' << translation[0] << ' ' << translation[1] << ' ' << translation[2] 
+                << ' ' << rotation.coeffs()[0] << ' ' << rotation.coeffs()[1] << ' ' 
+                << rotation.coeffs()[2] << ' ' << rotation.coeffs()[3] << endl;
+}
+
+// last component of the dataset path, names the trajectory file
+string sequenceName(string dir) {
+    while (dir.size() > 1 && dir.back() == '/') {
+        dir.pop_back();
+    }
+    size_t slash = dir.find_last_of('/');
+    return slash == string::npos ? dir : dir.substr(slash + 1);
+}
+
+int main ( int argc, char** argv )
+{
+    if ( argc < 4 )
+    {
+        cout<<"usage: run_sessions parameter_file output_dir dataset_dir [dataset_dir ...]"<<endl;
+        return 1;
+    }
+
+    myslam::Config::setParameterFile ( argv[1] );
+    const string output_dir = argv[2];
+
+    // the sequences share the camera intrinsics of the parameter file
+    myslam::Camera::Ptr camera ( new myslam::Camera );
+    vector<myslam::Session::Ptr> sessions;
+    vector<string> names;
+    for (int i = 3; i < argc; i++) {
+        myslam::Session::Ptr session ( new myslam::Session ( argv[i], camera ) );
+        if ( !session->isOpened() )
+        {
+            cout<<"no associate.txt in "<<argv[i]<<endl;
+            return 1;
+        }
+        sessions.push_back(session);
+        names.push_back(sequenceName(argv[i]));
+    }
+
+    vector<std::thread> threads;
+    vector<char> tracked(sessions.size(), 0);
+    for (size_t i = 0; i < sessions.size(); i++) {
+        threads.push_back(std::thread([&sessions, &tracked, i] { tracked[i] = sessions[i]->run(); }));
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    int lost = 0;
+    for (size_t i = 0; i < sessions.size(); i++) {
+        cout << names[i] << ": " << sessions[i]->getFrameCount() << " frames, "
+             << (tracked[i] ? "tracked" : "lost") << endl;
+        lost += !tracked[i];
+
+        ofstream fout (output_dir + "/" + names[i] + ".txt");
+        fout << "# estimated trajectory format" << endl;
+        fout << "# timestamp tx ty tz qx qy qz qw" << endl;
+        for(auto& stampedPose: sessions[i]->getMap()->getTrajectory()) {
+            writePosetoFile(fout, std::to_string(stampedPose.first), stampedPose.second);
+        }
+    }
+
+    return lost == 0 ? 0 : 1;
+}
@@ -5,14 +5,19 @@
 #include <iostream>
 #include <boost/timer.hpp>
 #include <opencv2/core.hpp>
-#include <opencv2/imgcodecs.hpp>
 #include <Eigen/Core>
 #include "myslam/config.h"
 #include "myslam/frontend.h"
+#ifdef MYSLAM_WITH_VIEWER
 #include "myslam/viewer.h"
+#endif
 #include "myslam/map.h"
+#include "myslam/map_io.h"
 #include "myslam/backend.h"
 #include "myslam/frame.h"
+#include "myslam/frame_loader.h"
+#include "myslam/profiler.h"
+#include "myslam/output_sink.h"
 
 void writePosetoFile(ofstream& outputFile, const string& timestamp, const SE3& pose) {
     Vector3d translation = pose.translation();
@@ -34,63 +39,82 @@ int main ( int argc, char** argv )
 
     string dataset_dir = myslam::Config::get<string> ( "dataset_dir" );
     cout<<"Path of dataset: "<<dataset_dir<<endl;
-    ifstream fin ( dataset_dir+"/associate.txt" );
-    if ( !fin )
+
+    cout << "Initializing VO system ..." << endl;
+
+    myslam::Camera::Ptr camera ( new myslam::Camera );
+    myslam::Map::Ptr map ( new myslam::Map );
+
+    // relocalize against a prebuilt map instead of starting from scratch
+    if (myslam::Config::get<int> ( "load_map" )) {
+        if (!myslam::MapIO::load(myslam::Config::get<string> ( "map_file" ), camera, map)) {
+            return 1;
+        }
+    }
+
+    // the new frames are numbered after the keyframes of a loaded map
+    myslam::FrameLoader::Ptr loader ( new myslam::FrameLoader ( dataset_dir, camera, map->getNextFrameId() ) );
+    if ( !loader->isOpened() )
     {
         cout<<"please generate the associate file called associate.txt!"<<endl;
         return 1;
     }
 
-    vector<string> rgb_files, depth_files;
-    vector<double> rgb_times, depth_times;
-    while ( !fin.eof() )
-    {
-        string rgb_time, rgb_file, depth_time, depth_file;
-        fin>>rgb_time>>rgb_file>>depth_time>>depth_file;
-        rgb_times.push_back ( atof ( rgb_time.c_str() ) );
-        depth_times.push_back ( atof ( depth_time.c_str() ) );
-        rgb_files.push_back ( dataset_dir+"/"+rgb_file );
-        depth_files.push_back ( dataset_dir+"/"+depth_file );
-
-        if ( fin.good() == false )
-            break;
+    myslam::FrontEnd::Ptr frontend ( new myslam::FrontEnd ( map ) );
+#ifdef MYSLAM_WITH_VIEWER
+    myslam::Viewer::Ptr viewer;
+    if (myslam::Config::get<int> ( "enable_viewer" )) {
+        viewer = myslam::Viewer::Ptr(new myslam::Viewer(map));
+        frontend->setViewer(viewer);
     }
-    fin.close();
-
-    cout << "Initializing VO system ..." << endl;
+#endif
 
-    myslam::Camera::Ptr camera ( new myslam::Camera );
-    myslam::FrontEnd::Ptr frontend ( new myslam::FrontEnd );
-    myslam::Viewer::Ptr viewer (new myslam::Viewer );
-
-    frontend->setViewer(viewer);
+    // stream the tracked poses and the backend updates while running
+    myslam::OutputSink::Ptr outputSink;
+    if (myslam::Config::get<int> ( "stream_output" )) {
+        outputSink = myslam::OutputSink::Ptr(new myslam::OutputSink(myslam::Config::get<string> ( "stream_file" )));
+    }
 
     myslam::Backend::Ptr backend;
     if (myslam::Config::get<int> ( "enable_local_optimization" )) {
         cout << "Enable local optimization" << endl;
-        backend = myslam::Backend::Ptr(new myslam::Backend);
+        backend = myslam::Backend::Ptr(new myslam::Backend(map));
         backend->setCamera(camera);
+        backend->setOutputSink(outputSink);
         frontend->setBackend(backend); 
     }
 
+    if (myslam::Config::get<int> ( "profiling" )) {
+        string traceFile = myslam::Config::get<int> ( "chrome_trace" ) ?
+                           myslam::Config::get<string> ( "trace_file" ) : "";
+        myslam::Profiler::getInstance().open(myslam::Config::get<string> ( "profile_file" ), traceFile);
+    }
+
+    // extract features of the next frames on a separate thread while tracking,
+    // the fast tracking modes only extract at the keyframes
+    myslam::FeatureExtractor::Ptr extractor = frontend->getFeatureExtractor();
+    if (myslam::Config::get<int> ( "pipelined_tracking" ) && frontend->extractsEveryFrame()) {
+        cout << "Enable pipelined tracking" << endl;
+        extractor->start([&loader] { return loader->next(); });
+    }
+
     cout << "Finish initialization!" << endl;
 
-    cout<<"Total "<<rgb_files.size() <<" images from dataset\n\n";
-    for ( int i=0; i<rgb_files.size(); i++ )
+    cout<<"Total "<<loader->size() <<" images from dataset\n\n";
+    for ( int i=0; ; i++ )
     {
-        Mat color = cv::imread ( rgb_files[i] );
-        Mat depth = cv::imread ( depth_files[i], -1 );
-        if ( color.data==nullptr || depth.data==nullptr )
+        myslam::Frame::Ptr pFrame = extractor->isPipelined() ? extractor->next() : loader->next();
+        if ( pFrame == nullptr )
             break;
-        myslam::Frame::Ptr pFrame = myslam::Frame::createFrame();
-        pFrame->camera_ = camera;
-        pFrame->color_ = color;
-        pFrame->depth_ = depth;
-        pFrame->time_stamp_ = rgb_times[i];
 
         cout << "Image #" << i << endl;
         boost::timer timer;
-        frontend->addFrame ( pFrame );
+        myslam::Profiler::getInstance().beginFrame(pFrame->getId());
+        bool tracked = frontend->addFrame ( pFrame );
+        myslam::Profiler::getInstance().endFrame();
+        if ( outputSink && tracked && frontend->getState() == myslam::FrontEnd::TRACKING ) {
+            outputSink->writeFramePose(pFrame);
+        }
         cout<<"Time cost (s): "<<timer.elapsed()<<endl<<endl;
 
         if ( frontend->getState() == myslam::FrontEnd::LOST ) {
@@ -99,23 +123,48 @@ int main ( int argc, char** argv )
         }
     }
 
-    cout << "Finished. \nPress <enter> to continue\n"; 
-    cin.get();
+    extractor->Stop();
+    loader->Stop();
+
+    cout << "Finished." << endl;
+#ifdef MYSLAM_WITH_VIEWER
+    // keep the viewer open until the user is done with it
+    if (viewer) {
+        cout << "Press <enter> to continue\n";
+        cin.get();
+    }
+#endif
+
+    // finish the queued local BA passes, the outputs below all have the last optimization
+    if (myslam::Config::get<int> ( "enable_local_optimization" )) {
+        backend->Stop();
+    }
 
     ofstream fout (myslam::Config::get<string> ( "output_file" ));
     fout << "# estimated trajectory format" << endl;
     fout << "# timestamp tx ty tz qx qy qz qw" << endl;
-    for(auto keyFrameMap: myslam::Map::getInstance().getAllKeyFrames()) {
-        auto keyFrame = keyFrameMap.second;
-        writePosetoFile(fout, std::to_string(keyFrame->time_stamp_), keyFrame->getPose());
+    for(auto& stampedPose: map->getTrajectory()) {
+        writePosetoFile(fout, std::to_string(stampedPose.first), stampedPose.second);
     }
     fout.close();
 
-    if (myslam::Config::get<int> ( "enable_local_optimization" )) {
-        backend->Stop();
+    // after the backend, its last pass is streamed too
+    if (outputSink) {
+        outputSink->Stop();
+    }
+
+    // after the backend, the saved map has its last optimization
+    if (myslam::Config::get<int> ( "save_map" )) {
+        myslam::MapIO::save(myslam::Config::get<string> ( "map_file" ), map);
+    }
+
+#ifdef MYSLAM_WITH_VIEWER
+    if (viewer) {
+        viewer->Close();
     }
+#endif
 
-    viewer->Close();
+    myslam::Profiler::getInstance().close();
 
     return 0;
 }
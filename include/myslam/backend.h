@@ -1,52 +1,80 @@
 #ifndef MYSLAM_BACKEND_H
 #define MYSLAM_BACKEND_H
 
+#include <deque>
+#include <future>
 #include "myslam/common_include.h"
 #include "myslam/map.h"
 #include "myslam/camera.h"
 #include "myslam/frame.h"
+#include "myslam/output_sink.h"
 
 namespace myslam {
 
+class LocalBundleAdjustment;
+
 class Backend {
 public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
     typedef std::shared_ptr<Backend> Ptr;
 
-    Backend() {
-        backendRunning_ = true;
-        backendThread_ = std::thread(std::bind(&Backend::backendLoop, this));
+    // optimizes map, the map of the frontend of the same session
+    explicit Backend(const Map::Ptr& map) : map_(map) {
         chi2_th_ = Config::get<float>("chi2_th");
+        incrementalBA_ = Config::get<int>("incremental_ba");
+        passScheduled_ = false;
     }
 
-    void Stop() {
-        backendRunning_ = false;
-        mapUpdate_.notify_one();
-        backendThread_.join();
-    }
+    ~Backend() { Stop(); }
 
-    void optimizeCovisibilityGraph(const Frame::Ptr& keyFrameCurr) {
+    // finish the queued keyframes, the passes run as background tasks of the scheduler
+    void Stop() {
         unique_lock<mutex> lock(backendMutex_);
-        keyFrameCurr_ = keyFrameCurr;
-        mapUpdate_.notify_one();
+        passDone_.wait(lock, [this] { return !passScheduled_; });
     }
 
+    /*
+      Queue a new keyframe for local optimization without waiting.
+      Keyframes queued while an optimization is running are optimized
+      together in the next one. The future is ready once it is done.
+    */
+    shared_future<void> optimizeCovisibilityGraph(const Frame::Ptr& keyFrameCurr);
+
     void setCamera(const Camera::Ptr& camera) { camera_ = camera; }
 
+    // receives the optimized poses and positions after every pass, set before the first keyframe
+    void setOutputSink(const OutputSink::Ptr& sink) { outputSink_ = sink; }
+
 private:
 
-    bool backendRunning_;
-    thread backendThread_;
-    mutex backendMutex_;
-    condition_variable mapUpdate_;
-    void backendLoop();
+    struct Job {
+        Frame::Ptr keyFrame;
+        shared_ptr<promise<void>> done;
+    };
+
+    bool passScheduled_;            // a pass is queued or running on the scheduler
+    mutex backendMutex_;            // guards jobs_ and passScheduled_ only
+    condition_variable passDone_;
+    std::deque<Job> jobs_;          // keyframes waiting for optimization
+
+    /*
+      One optimization of all the queued keyframes, resubmitted while new ones
+      were queued meanwhile, so that the tracking tasks can run in between.
+    */
+    void optimizePass();
 
-    void optimize();
+    // local BA over the given keyframes and their connected keyframes
+    void optimize(const vector<Frame::Ptr>& keyFrames);
 
+    Map::Ptr map_;
     Camera::Ptr camera_;
-    Frame::Ptr keyFrameCurr_;
+
+    shared_ptr<LocalBundleAdjustment> localBA_;    // created by the first pass, the passes never overlap
+
+    OutputSink::Ptr outputSink_;    // nullptr if the results are not streamed
 
     float chi2_th_;
+    bool incrementalBA_;    // keep the g2o graph between two optimizations
 
 }; // class Backend
 
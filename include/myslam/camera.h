@@ -21,24 +21,60 @@
 #define CAMERA_H
 
 #include "myslam/common_include.h"
+#include "myslam/camera_model.h"
 
 namespace myslam
 {
 
-// Pinhole RGBD camera model
+/*
+  Points projected together by Camera::projectBatch, struct of arrays so the
+  projection runs on packed Eigen arrays. clear() keeps the capacity, a buffer
+  reused every frame does not allocate.
+*/
+struct ProjectionBatch
+{
+    // input: world position and mean viewing direction of each point
+    vector<float> x, y, z;
+    vector<float> nx, ny, nz;
+
+    // output: pixel, depth in the camera, cosine between the viewing direction
+    // from the camera center and the mean one, and the visibility mask
+    vector<float> u, v, depth, cosAngle;
+    vector<uchar> visible;
+
+    void clear() {
+        x.clear(); y.clear(); z.clear();
+        nx.clear(); ny.clear(); nz.clear();
+    }
+
+    void add(const Vector3d& pos, const Vector3d& norm) {
+        x.push_back(pos[0]); y.push_back(pos[1]); z.push_back(pos[2]);
+        nx.push_back(norm[0]); ny.push_back(norm[1]); nz.push_back(norm[2]);
+    }
+
+    size_t size() const { return x.size(); }
+};
+
+/*
+  RGBD camera with the pinhole model, and the radial-tangential distortion
+  when one of its coefficients is set. The transforms are inline, the inner
+  loops take the model itself with getPinhole() or getRadialTangential().
+*/
 class Camera
 {
 public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
     typedef std::shared_ptr<Camera> Ptr;
     float   fx_, fy_, cx_, cy_, depth_scale_;  // Camera intrinsics 
+    float   k1_, k2_, p1_, p2_;                // distortion coefficients, all 0 without distortion
 
     Camera();
     Camera ( float fx, float fy, float cx, float cy, float depth_scale=0 ) :
-        fx_ ( fx ), fy_ ( fy ), cx_ ( cx ), cy_ ( cy ), depth_scale_ ( depth_scale )
+        fx_ ( fx ), fy_ ( fy ), cx_ ( cx ), cy_ ( cy ), depth_scale_ ( depth_scale ),
+        k1_ ( 0 ), k2_ ( 0 ), p1_ ( 0 ), p2_ ( 0 )
     {}
 
-    Mat getCameraMatrix () {
+    Mat getCameraMatrix () const {
         Mat K = ( cv::Mat_<double>(3,3)<<
                     fx_, 0,   cx_,
                     0,   fy_, cy_,
@@ -46,17 +82,74 @@ public:
         return K;
     }
 
+    // k1, k2, p1, p2 as cv::solvePnP expects them
+    Mat getDistortionCoeffs () const {
+        return ( cv::Mat_<double>(4,1) << k1_, k2_, p1_, p2_ );
+    }
+
+    bool hasDistortion () const {
+        return k1_ != 0 || k2_ != 0 || p1_ != 0 || p2_ != 0;
+    }
+
+    // the camera models, see camera_model.h
+    PinholeModel<double> getPinhole () const {
+        return PinholeModel<double> ( fx_, fy_, cx_, cy_ );
+    }
+
+    RadialTangentialModel<double> getRadialTangential () const {
+        return RadialTangentialModel<double> ( fx_, fy_, cx_, cy_, k1_, k2_, p1_, p2_ );
+    }
+
+    RGBDModel<PinholeModel<double>> getRGBD () const {
+        return RGBDModel<PinholeModel<double>> ( getPinhole(), depth_scale_ );
+    }
+
     // coordinate transform: world, camera, pixel
-    Vector3d world2camera( const Vector3d& p_w, const SE3& T_c_w );
-    Vector3d camera2world( const Vector3d& p_c, const SE3& T_c_w );
-    Vector2d camera2pixel( const Vector3d& p_c );
-    Vector3d pixel2camera( const Vector2d& p_p, double depth=1 ); 
-    Vector3d pixel2world ( const Vector2d& p_p, const SE3& T_c_w, double depth=1 );
-    Vector2d world2pixel ( const Vector3d& p_w, const SE3& T_c_w );
+    Vector3d world2camera( const Vector3d& p_w, const SE3& T_c_w ) const {
+        return T_c_w*p_w;
+    }
+
+    Vector3d camera2world( const Vector3d& p_c, const SE3& T_c_w ) const {
+        return T_c_w.inverse() *p_c;
+    }
+
+    Vector2d camera2pixel( const Vector3d& p_c ) const {
+        return hasDistortion() ? getRadialTangential().project(p_c) : getPinhole().project(p_c);
+    }
+
+    Vector3d pixel2camera( const Vector2d& p_p, double depth=1 ) const {
+        return hasDistortion() ? getRadialTangential().unproject(p_p, depth) : getPinhole().unproject(p_p, depth);
+    }
+
+    Vector3d pixel2world ( const Vector2d& p_p, const SE3& T_c_w, double depth=1 ) const {
+        return camera2world ( pixel2camera ( p_p, depth ), T_c_w );
+    }
+
+    Vector2d world2pixel ( const Vector3d& p_w, const SE3& T_c_w ) const {
+        return camera2pixel ( world2camera ( p_w, T_c_w ) );
+    }
+
+    // d camera2pixel / d p_c
+    void projectJacobian( const Vector3d& p_c, Eigen::Matrix<double, 2, 3>& J ) const {
+        if ( hasDistortion() ) {
+            getRadialTangential().projectJacobian(p_c, J);
+        } else {
+            getPinhole().projectJacobian(p_c, J);
+        }
+    }
 
     // overload functions
-    Vector3d pixel2world ( const cv::KeyPoint& p_p, const SE3& T_c_w, double depth=1 );
-    Vector3d pixel2camera( const cv::Point2f& p_p, double depth=1 ); 
+    Vector3d pixel2world ( const cv::KeyPoint& p_p, const SE3& T_c_w, double depth=1 ) const {
+        return pixel2world ( Vector2d ( p_p.pt.x, p_p.pt.y ), T_c_w, depth );
+    }
+
+    Vector3d pixel2camera( const cv::Point2f& p_p, double depth=1 ) const {
+        return pixel2camera ( Vector2d ( p_p.x, p_p.y ), depth );
+    }
+
+    // project all the points of batch with T_c_w in one pass, visible if in front
+    // of the camera and inside an image of width x height
+    void projectBatch( const SE3& T_c_w, const int width, const int height, ProjectionBatch& batch ) const;
 };
 
 }
@@ -0,0 +1,156 @@
+#ifndef MYSLAM_CAMERA_MODEL_H
+#define MYSLAM_CAMERA_MODEL_H
+
+#include "myslam/common_include.h"
+
+namespace myslam {
+
+/*
+  Camera models as small value types with inline projection, for the inner
+  loops of the optimizers and the g2o edges: a kernel templated on the model
+  holds it by value, so every evaluation is a few multiplications without a
+  call through Camera::Ptr. The models share one interface:
+
+    Vector2 project(const Vector3& p_c)                 camera to pixel
+    Vector3 unproject(const Vector2& pixel, depth)      pixel to camera
+    void projectJacobian(const Vector3& p_c, Matrix23&) d pixel / d p_c
+
+  Camera hands out the models of its intrinsics, see Camera::getPinhole().
+*/
+
+// linear projection with the focal lengths and the principal point
+template<typename T>
+struct PinholeModel {
+    typedef T Scalar;
+    typedef Eigen::Matrix<T, 2, 1> Vector2;
+    typedef Eigen::Matrix<T, 3, 1> Vector3;
+    typedef Eigen::Matrix<T, 2, 3> Matrix23;
+    static constexpr bool DISTORTED = false;
+
+    T fx, fy, cx, cy;
+
+    constexpr PinholeModel(const T fx, const T fy, const T cx, const T cy)
+    : fx(fx), fy(fy), cx(cx), cy(cy) {}
+
+    Vector2 project(const Vector3& p_c) const {
+        const T zinv = T(1) / p_c[2];
+        return Vector2(fx * p_c[0] * zinv + cx, fy * p_c[1] * zinv + cy);
+    }
+
+    Vector3 unproject(const Vector2& pixel, const T depth) const {
+        return Vector3((pixel[0] - cx) * depth / fx, (pixel[1] - cy) * depth / fy, depth);
+    }
+
+    void projectJacobian(const Vector3& p_c, Matrix23& J) const {
+        const T zinv = T(1) / p_c[2];
+        const T zinv2 = zinv * zinv;
+        J << fx * zinv, T(0), -fx * p_c[0] * zinv2,
+             T(0), fy * zinv, -fy * p_c[1] * zinv2;
+    }
+};
+
+// pinhole with the radial (k1, k2) and tangential (p1, p2) distortion of OpenCV
+template<typename T>
+struct RadialTangentialModel {
+    typedef T Scalar;
+    typedef Eigen::Matrix<T, 2, 1> Vector2;
+    typedef Eigen::Matrix<T, 3, 1> Vector3;
+    typedef Eigen::Matrix<T, 2, 3> Matrix23;
+    static constexpr bool DISTORTED = true;
+    static constexpr int UNDISTORT_ITERATIONS = 10;
+
+    T fx, fy, cx, cy;
+    T k1, k2, p1, p2;
+
+    constexpr RadialTangentialModel(const T fx, const T fy, const T cx, const T cy,
+                                    const T k1, const T k2, const T p1, const T p2)
+    : fx(fx), fy(fy), cx(cx), cy(cy), k1(k1), k2(k2), p1(p1), p2(p2) {}
+
+    // distorted point of the normalized plane
+    Vector2 distort(const T x, const T y) const {
+        const T r2 = x * x + y * y;
+        const T radial = T(1) + r2 * (k1 + k2 * r2);
+        return Vector2(x * radial + T(2) * p1 * x * y + p2 * (r2 + T(2) * x * x),
+                       y * radial + p1 * (r2 + T(2) * y * y) + T(2) * p2 * x * y);
+    }
+
+    Vector2 project(const Vector3& p_c) const {
+        const T zinv = T(1) / p_c[2];
+        const Vector2 d = distort(p_c[0] * zinv, p_c[1] * zinv);
+        return Vector2(fx * d[0] + cx, fy * d[1] + cy);
+    }
+
+    // fixed point iterations on the normalized plane, as cv::undistortPoints
+    Vector3 unproject(const Vector2& pixel, const T depth) const {
+        const T xd = (pixel[0] - cx) / fx, yd = (pixel[1] - cy) / fy;
+        T x = xd, y = yd;
+        for (int i = 0; i < UNDISTORT_ITERATIONS; i++) {
+            const T r2 = x * x + y * y;
+            const T radial = T(1) + r2 * (k1 + k2 * r2);
+            const T dx = T(2) * p1 * x * y + p2 * (r2 + T(2) * x * x);
+            const T dy = p1 * (r2 + T(2) * y * y) + T(2) * p2 * x * y;
+            x = (xd - dx) / radial;
+            y = (yd - dy) / radial;
+        }
+        return Vector3(x * depth, y * depth, depth);
+    }
+
+    void projectJacobian(const Vector3& p_c, Matrix23& J) const {
+        const T zinv = T(1) / p_c[2];
+        const T x = p_c[0] * zinv, y = p_c[1] * zinv;
+        const T r2 = x * x + y * y;
+        const T radial = T(1) + r2 * (k1 + k2 * r2);
+        const T dRadial = T(2) * k1 + T(4) * k2 * r2;     // d radial / d r2, times 2
+
+        // d distorted / d normalized
+        const T dxdx = radial + dRadial * x * x + T(2) * p1 * y + T(6) * p2 * x;
+        const T dxdy = dRadial * x * y + T(2) * p1 * x + T(2) * p2 * y;
+        const T dydx = dxdy;
+        const T dydy = radial + dRadial * y * y + T(6) * p1 * y + T(2) * p2 * x;
+
+        // d normalized / d p_c is [zinv, 0, -x * zinv; 0, zinv, -y * zinv]
+        J << fx * dxdx * zinv, fx * dxdy * zinv, -fx * (dxdx * x + dxdy * y) * zinv,
+             fy * dydx * zinv, fy * dydy * zinv, -fy * (dydx * x + dydy * y) * zinv;
+    }
+};
+
+// a projection model with the scale of the raw depth image
+template<class Projection>
+struct RGBDModel : public Projection {
+    typedef typename Projection::Scalar Scalar;
+    typedef typename Projection::Vector2 Vector2;
+    typedef typename Projection::Vector3 Vector3;
+
+    Scalar depthScale;      // raw depth units per meter
+
+    constexpr RGBDModel(const Projection& projection, const Scalar depthScale)
+    : Projection(projection), depthScale(depthScale) {}
+
+    Scalar depthFromRaw(const ushort raw) const { return Scalar(raw) / depthScale; }
+
+    // camera point of a pixel with its raw depth, the depth must not be 0
+    Vector3 backProject(const Vector2& pixel, const ushort raw) const {
+        return this->unproject(pixel, depthFromRaw(raw));
+    }
+};
+
+/*
+  Jacobian of the projection of T * p_w w.r.t. the left perturbation of T,
+  translation first as VertexPose
+  @param p_c  T * p_w
+*/
+template<class Model>
+inline void projectPoseJacobian(const Model& model, const typename Model::Vector3& p_c,
+                                Eigen::Matrix<typename Model::Scalar, 2, 6>& J) {
+    typename Model::Matrix23 Jp;
+    model.projectJacobian(p_c, Jp);
+    // d p_c / d xi = [I, -p_c^]
+    J.template leftCols<3>() = Jp;
+    J.col(3) = Jp.col(2) * p_c[1] - Jp.col(1) * p_c[2];
+    J.col(4) = Jp.col(0) * p_c[2] - Jp.col(2) * p_c[0];
+    J.col(5) = Jp.col(1) * p_c[0] - Jp.col(0) * p_c[1];
+}
+
+} // namespace
+
+#endif  // MYSLAM_CAMERA_MODEL_H
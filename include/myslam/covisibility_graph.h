@@ -0,0 +1,86 @@
+#ifndef MYSLAM_COVISIBILITY_GRAPH_H
+#define MYSLAM_COVISIBILITY_GRAPH_H
+
+#include "myslam/common_include.h"
+
+namespace myslam {
+
+/*
+  Keyframe - mappoint observations and the covisibility weights between keyframes.
+  Keyframes and mappoints get dense slots, reused once freed, and the adjacency
+  of each node is a contiguous vector. Every observation knows its position in
+  the lists of both its ends, so it is removed with a swap in O(1), and the
+  weights of the keyframes sharing the mappoint are updated incrementally.
+  Thread-safe.
+*/
+class CovisibilityGraph {
+public:
+    typedef std::shared_ptr<CovisibilityGraph> Ptr;
+    typedef unordered_map<unsigned long, int> ConnectedKeyFrames;  // keyframe id to weight
+
+    // connections below minWeight are only reported when there is no stronger one
+    explicit CovisibilityGraph(const int minWeight) : minWeight_(minWeight) {}
+
+    // no effect if the observation exists
+    void addObservation(const unsigned long keyFrameId, const unsigned long mapPointId);
+
+    // no effect if the observation does not exist
+    void removeObservation(const unsigned long keyFrameId, const unsigned long mapPointId);
+
+    // remove all the observations of a keyframe and free its slot
+    void removeKeyFrame(const unsigned long keyFrameId);
+
+    /*
+      Keyframes sharing at least minWeight mappoints with keyFrameId,
+      or only the one sharing the most if none reaches minWeight.
+    */
+    ConnectedKeyFrames getConnectedKeyFrames(const unsigned long keyFrameId);
+
+    // number of mappoints observed by both keyframes
+    int getWeight(const unsigned long keyFrameId1, const unsigned long keyFrameId2);
+
+    void clear();
+
+private:
+    // an end of an observation: slot of the other node, position in its list
+    struct Link {
+        int slot;
+        int pos;
+    };
+
+    struct KeyFrameNode {
+        unsigned long id;
+        vector<Link> mapPoints;
+        vector<pair<int, int>> neighbors;   // keyframe slot, weight > 0
+    };
+
+    struct MapPointNode {
+        unsigned long id;
+        vector<Link> keyFrames;
+    };
+
+    mutex mutex_;
+    int minWeight_;
+
+    vector<KeyFrameNode> keyFrames_;
+    vector<MapPointNode> mapPoints_;
+    vector<int> freeKeyFrameSlots_;
+    vector<int> freeMapPointSlots_;
+    unordered_map<unsigned long, int> keyFrameSlots_;   // id to slot
+    unordered_map<unsigned long, int> mapPointSlots_;
+
+    int keyFrameSlot(const unsigned long id);
+    int mapPointSlot(const unsigned long id);
+
+    // add delta to the weight between two keyframe slots, on both sides
+    void addWeight(const int kf1, const int kf2, const int delta);
+    static void addNeighborWeight(KeyFrameNode& node, const int other, const int delta);
+
+    // remove the i-th observation of a keyframe slot, return true if its mappoint has no more observation
+    bool removeObservationAt(const int kf, const int i);
+
+}; // class CovisibilityGraph
+
+} // namespace
+
+#endif  // MYSLAM_COVISIBILITY_GRAPH_H
@@ -0,0 +1,67 @@
+#ifndef MYSLAM_DEPTH_PREPROCESSOR_H
+#define MYSLAM_DEPTH_PREPROCESSOR_H
+
+#include "myslam/common_include.h"
+#include "myslam/camera.h"
+
+namespace myslam {
+
+/*
+  Back-projection rays of the pixel grid of a camera: the pixel (x, y) with
+  depth d is (rayX[x] * d, rayY[y] * d, d) in the camera. The pinhole model is
+  separable, so one table per axis covers every pixel. The distorted cameras
+  have no table, their rays are not separable.
+*/
+struct BackProjectionTable {
+    typedef std::shared_ptr<const BackProjectionTable> ConstPtr;
+
+    vector<float> rayX, rayY;
+    float invFx, invFy;
+
+    BackProjectionTable(const Camera& camera, const int width, const int height);
+
+    // sub-pixel point, exact since the pinhole rays are linear in the pixel coordinates
+    Vector3d backProject(const float x, const float y, const double depth) const {
+        const int x0 = min(max(int(x), 0), int(rayX.size()) - 1);
+        const int y0 = min(max(int(y), 0), int(rayY.size()) - 1);
+        return Vector3d((rayX[x0] + (x - x0) * invFx) * depth, (rayY[y0] + (y - y0) * invFy) * depth, depth);
+    }
+};
+
+/*
+  Converts the raw depth images once per frame, on the loader threads:
+  metric float depth with 0 for the invalid pixels, optional hole filling
+  from the 4 neighbours and bilateral filtering.
+*/
+class DepthPreprocessor {
+public:
+    typedef std::shared_ptr<DepthPreprocessor> Ptr;
+
+    explicit DepthPreprocessor(const Camera::Ptr& camera);
+
+    /*
+      @param raw      depth image in the unit of the camera depth scale, CV_16U
+      @param depth    out: CV_32F depth in meter, 0 if invalid
+    */
+    void process(const Mat& raw, Mat& depth) const;
+
+    // table of the image size, built on first use and then shared by all the frames,
+    // nullptr if the camera has distortion
+    BackProjectionTable::ConstPtr getBackProjectionTable(const int width, const int height);
+
+private:
+    Camera::Ptr camera_;
+    bool fillHoles_;
+    bool bilateralFilter_;
+    int bilateralDiameter_;
+    double bilateralSigmaDepth_;    // in meter
+    double bilateralSigmaSpace_;    // in pixel
+
+    mutex tableMutex_;
+    BackProjectionTable::ConstPtr table_;
+
+}; // class DepthPreprocessor
+
+} // namespace
+
+#endif  // MYSLAM_DEPTH_PREPROCESSOR_H
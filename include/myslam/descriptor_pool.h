@@ -0,0 +1,60 @@
+#ifndef MYSLAM_DESCRIPTOR_POOL_H
+#define MYSLAM_DESCRIPTOR_POOL_H
+
+#include "myslam/common_include.h"
+
+namespace myslam {
+
+/*
+  Contiguous storage of the 32-byte ORB descriptors of the mappoints.
+  Descriptors live in 32-byte aligned blocks which are never moved, so the
+  pointer returned by allocate() stays valid until release().
+  Released slots are reused by later allocations.
+  Descriptors stored elsewhere, e.g. in a memory mapped map file, can be
+  attached and used in place, they are never written nor reused.
+*/
+class DescriptorPool {
+public:
+    typedef std::shared_ptr<DescriptorPool> Ptr;
+    static const int DESCRIPTOR_SIZE = 32;   // bytes of an ORB descriptor
+
+    explicit DescriptorPool(const size_t blockSize = 4096);
+
+    ~DescriptorPool();
+
+    // copy a descriptor into the pool
+    const uchar* allocate(const uchar* descriptor);
+
+    // give a slot returned by allocate() or attach() back to the pool
+    void release(const uchar* descriptor);
+
+    /*
+      Use count contiguous read-only descriptors in place.
+      @param owner  keeps the memory alive as long as the pool
+    */
+    void attach(const uchar* descriptors, const size_t count, const shared_ptr<const void>& owner);
+
+    size_t size() {
+        unique_lock<mutex> lck(poolMutex_);
+        return usedSlots_;
+    }
+
+private:
+    mutex poolMutex_;
+    size_t blockSize_;              // number of descriptors per block
+    vector<uchar*> blocks_;
+    size_t nextSlotInBlock_;        // first never used slot of the last block
+    vector<uchar*> freeSlots_;
+    size_t usedSlots_;
+
+    // attached descriptors, [begin, end) of each range
+    vector<pair<const uchar*, const uchar*>> attached_;
+    vector<shared_ptr<const void>> attachedOwners_;
+
+    bool isAttached(const uchar* descriptor) const;
+
+}; // class DescriptorPool
+
+} // namespace
+
+#endif  // MYSLAM_DESCRIPTOR_POOL_H
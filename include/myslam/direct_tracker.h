@@ -0,0 +1,102 @@
+#ifndef MYSLAM_DIRECT_TRACKER_H
+#define MYSLAM_DIRECT_TRACKER_H
+
+#include "myslam/common_include.h"
+#include "myslam/frame.h"
+
+namespace myslam {
+
+/*
+  Dense RGB-D alignment of a frame against the reference keyframe, without features.
+  The pixels of the keyframe with a valid depth and enough intensity gradient are
+  warped into the frame, the pose minimizes their photometric error plus the
+  error between their warped depth and the depth image. Gauss-Newton with the
+  Huber kernel, coarse to fine on image pyramids. Same parameterization as
+  VertexPose (left multiplication, translation first).
+*/
+class DirectTracker {
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+    typedef std::shared_ptr<DirectTracker> Ptr;
+
+    DirectTracker();
+
+    // build the pyramids of the keyframe and select its pixels
+    void setReference(const Frame::Ptr& keyFrame);
+
+    bool hasReference() const { return reference_ != nullptr; }
+
+    /*
+      Align frame to the reference keyframe, with its current pose.
+      @param pose  in: initial T_c_w of frame, out: the aligned one
+      @return false if it did not converge or too few pixels were still in view
+    */
+    bool track(const Frame::Ptr& frame, SE3& pose);
+
+    // fraction of the reference pixels of the finest level in view at the last track
+    float getValidRatio() const { return validRatio_; }
+
+private:
+    // images of one pyramid level, CV_32F
+    struct Level {
+        Mat gray, gradX, gradY;
+        Mat depth;                      // 0 if invalid
+        Mat depthInner;                 // depth with its 4 neighbours valid, 0 otherwise
+        Mat depthGradX, depthGradY;     // central differences, valid where depthInner is
+        float fx, fy, cx, cy;
+    };
+
+    // selected pixels of one level of the reference, struct of arrays
+    struct Points {
+        vector<float> x, y, z;          // in the reference camera
+        vector<float> intensity;
+
+        void clear() {
+            x.clear(); y.clear(); z.clear();
+            intensity.clear();
+        }
+
+        size_t size() const { return x.size(); }
+    };
+
+    // normal equations of a chunk of points
+    struct Accumulator {
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+        Eigen::Matrix<float, 6, 6> H;
+        Eigen::Matrix<float, 6, 1> b;
+        float cost;
+        int count;      // photometric residuals
+    };
+    typedef vector<Accumulator, Eigen::aligned_allocator<Accumulator>> Accumulators;
+
+    int levels_;                // pyramid levels
+    int iterations_;            // Gauss-Newton iterations per level
+    int maxPoints_;             // max selected pixels per level
+    float minGradient_;         // min intensity gradient of a selected pixel
+    float minDepth_, maxDepth_; // depth range of a selected pixel, in meter
+    float huberPhotometric_;    // in intensity
+    float geometricWeight_;     // intensity per meter of depth error, 0 disables the geometric term
+    float huberGeometric_;      // in meter
+    float minValidRatio_;
+
+    Frame::Ptr reference_;
+    vector<Points> referencePoints_;    // per level
+
+    // pyramid of the last tracked frame, reused when it becomes the reference
+    Frame::Ptr lastFrame_;
+    vector<Level> lastPyramid_;
+
+    Accumulators accumulators_;         // one per chunk, reused every iteration
+    float validRatio_;
+
+    void buildPyramid(const Frame::Ptr& frame, vector<Level>& pyramid) const;
+
+    // accumulate the normal equations of level at T_c_r in parallel, return the number of photometric residuals
+    int accumulate(const Level& level, const Points& points, const SE3& T_c_r,
+                   Eigen::Matrix<double, 6, 6>& H, Eigen::Matrix<double, 6, 1>& b, double& cost);
+
+}; // class DirectTracker
+
+} // namespace
+
+#endif  // MYSLAM_DIRECT_TRACKER_H
@@ -0,0 +1,102 @@
+#ifndef MYSLAM_FEATURE_EXTRACTOR_H
+#define MYSLAM_FEATURE_EXTRACTOR_H
+
+#include <functional>
+#include <queue>
+#include <opencv2/features2d/features2d.hpp>
+#include "myslam/common_include.h"
+#include "myslam/frame.h"
+
+namespace myslam {
+
+/*
+  ORB extraction stage of the frontend.
+  It can be called synchronously by the frontend, or run as a pipeline stage
+  on its own thread which pulls frames from a source and keeps up to
+  pipelineDepth_ frames with extracted features ready for tracking.
+*/
+class FeatureExtractor {
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+    typedef std::shared_ptr<FeatureExtractor> Ptr;
+    typedef std::function<Frame::Ptr()> FrameSource;
+
+    FeatureExtractor();
+
+    ~FeatureExtractor() { Stop(); }
+
+    // fill frame->keypoints_ and frame->descriptors_
+    void extract(const Frame::Ptr& frame);
+
+    // start the pipeline stage, source returns nullptr at the end of the sequence
+    void start(const FrameSource& source);
+
+    void Stop();
+
+    bool isPipelined() const { return extractorRunning_; }
+
+    /*
+      Change the feature count and the number of pyramid levels, at most the
+      configured ones. Applied from the next extraction, also on the pipeline thread.
+    */
+    void setBudget(const int numFeatures, const int numLevels);
+
+    // wall time of the last extraction
+    double getLastExtractionMs() const { return lastExtractionMs_; }
+
+    /*
+      Block until the next frame with features is ready.
+      Return nullptr if the source is exhausted.
+    */
+    Frame::Ptr next();
+
+private:
+    cv::Ptr<cv::ORB> orb_;  // orb detector and computer
+
+    // grid extraction, see config/default.yaml
+    bool gridExtraction_;           // use the grid extractor instead of orb_->detectAndCompute
+    int numFeatures_;               // total number of features over all levels
+    double scaleFactor_;            // scale between two pyramid levels
+    int numLevels_;                 // number of pyramid levels
+    int cellSize_;                  // cell size in pixel of the grid on each level
+    int iniThFAST_, minThFAST_;     // FAST threshold, the lower one is used for low texture cells
+    vector<int> featuresPerLevel_;   // feature budget of each level
+    vector<int> umax_;              // row bounds of the circular patch used for orientation
+    int maxLevels_;                 // the configured number of levels, numLevels_ may be lower
+    vector<cv::Ptr<cv::ORB>> levelOrbs_;  // single level descriptor computers, one per level up to maxLevels_
+
+    mutex budgetMutex_;             // guards the pending budget
+    int pendingFeatures_, pendingLevels_;
+    atomic<double> lastExtractionMs_;
+
+    // split numFeatures_ into featuresPerLevel_
+    void computeLevelBudgets();
+
+    // take the budget of setBudget before an extraction
+    void applyBudget();
+
+    // tile every pyramid level into cells, detect and describe them in parallel
+    void extractGrid(const Frame::Ptr& frame);
+
+    // keep the strongest keypoints of each cell in turns until the budget is used
+    void distributeKeyPoints(vector<vector<cv::KeyPoint>>& cellKeyPoints,
+                             const int budget,
+                             vector<cv::KeyPoint>& keypoints);
+
+    FrameSource source_;
+    size_t pipelineDepth_;
+
+    bool extractorRunning_;
+    thread extractorThread_;
+    mutex extractorMutex_;
+    condition_variable frameReady_;
+    condition_variable slotFree_;
+    std::queue<Frame::Ptr> readyFrames_;    // nullptr marks the end of the source
+
+    void extractorLoop();
+
+}; // class FeatureExtractor
+
+} // namespace
+
+#endif  // MYSLAM_FEATURE_EXTRACTOR_H
@@ -23,6 +23,9 @@
 #include "myslam/common_include.h"
 #include "myslam/camera.h"
 #include "myslam/util.h"
+#include "myslam/seqlock.h"
+#include "myslam/object_pool.h"
+#include "myslam/depth_preprocessor.h"
 
 namespace myslam 
 {
@@ -35,56 +38,59 @@ class Frame
 public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
     typedef shared_ptr<Frame> Ptr;
-    typedef unordered_map<unsigned long, int> ConnectedKeyFrameIdToWeight;
     double                         time_stamp_; // when it is recorded
     Camera::Ptr                    camera_;     // Pinhole RGBD Camera model 
-    Mat                            color_, depth_; // color and depth image 
+    Mat                            color_, depth_; // color and raw depth image, no raw depth with depthMeters_
+    Mat                            depthMeters_; // CV_32F depth in meter from DepthPreprocessor, 0 if invalid
+    BackProjectionTable::ConstPtr  backProjection_; // rays of the pixels, shared by the frames of the camera, nullptr with distortion
+    vector<cv::KeyPoint>           keypoints_;  // ORB keypoints, filled by FeatureExtractor
+    Mat                            descriptors_; // ORB descriptors of keypoints_
+    bool                           featuresExtracted_; // whether keypoints_ and descriptors_ are filled
     
     Frame();
     Frame( long id, double time_stamp=0, SE3 T_c_w=SE3(), Camera::Ptr camera=nullptr, Mat color=Mat(), Mat depth=Mat() );
     ~Frame();
     
-    // factory function
-    static Frame::Ptr createFrame(); 
+    // factory function, the id is given by the frame source of the session
+    static Frame::Ptr createFrame( const unsigned long id ); 
+
+    // keyframe with a given id, e.g. loaded from a map file, without images
+    static Frame::Ptr restoreKeyFrame( const unsigned long id, const double time_stamp, const SE3& T_c_w, const Camera::Ptr& camera );
     
-    // find the depth in depth map
-    double findDepth( const cv::KeyPoint& kp );
+    // find the depth in depth map, -1 if there is no valid depth
+    double findDepth( const cv::KeyPoint& kp ) const;
+
+    // point in the camera frame of a keypoint with its depth
+    Vector3d backProject( const cv::KeyPoint& kp, const double depth ) const;
     
     // Get Camera Center
     Vector3d getCamCenter() const;
     
     // check if a point is in this frame 
-    bool isInFrame( const Vector3d& pt_world );
+    bool isInFrame( const Vector3d& pt_world ) const;
 
-    SE3 getPose() {
-        unique_lock<mutex> lck(poseMutex_);
-        return T_c_w_;
+    // project the points of batch with the current pose, same visibility test as isInFrame
+    void projectBatch( ProjectionBatch& batch ) const {
+        camera_->projectBatch( getPose(), color_.cols, color_.rows, batch );
     }
 
-    SE3 setPose(const SE3& pose) {
-        unique_lock<mutex> lck(poseMutex_);
-        T_c_w_ = pose;
-    }
-
-    unsigned long getId() { return id_; }
+    // put the keypoints into a grid of cells with cellSize pixels, used for guided matching
+    void assignKeyPointsToGrid( const int cellSize );
 
-    // Update the co-visible key-frames when this frame is a key-frame 
-    void updateConnectedKeyFrames();
+    // indices of the keypoints within a radius r of pixel (x, y), needs assignKeyPointsToGrid
+    vector<size_t> getKeyPointsInArea( const float x, const float y, const float r ) const;
 
-    // Decrease the weight of connectedFrame by 1
-    void decreaseConnectedKeyFrameWeightByOne(const unsigned long id);
-
-    // Add the connection of another frame with weight to current frame
-    void addConnectedKeyFrame(const unsigned long id, const int weight) {
-        unique_lock<mutex> lck(connectedMutex_);
-        connectedKeyFrameIdToWeight_[id] = weight;
+    // the pose is written by the backend while the frontend and viewer read it
+    SE3 getPose() const {
+        return T_c_w_.load();
     }
 
-    ConnectedKeyFrameIdToWeight getConnectedKeyFrames() {
-        unique_lock<mutex> lck(connectedMutex_);
-        return connectedKeyFrameIdToWeight_;
+    void setPose(const SE3& pose) {
+        T_c_w_.store(pose);
     }
 
+    unsigned long getId() { return id_; }
+
     void addObservedMapPoint(const weak_ptr<MapPoint> mpt) {
         unique_lock<mutex> lck(observationMutex_);
         observedMapPoints_.push_back(mpt);
@@ -92,24 +98,23 @@ public:
 
     void removeObservedMapPoint(const shared_ptr<MapPoint> mpt);
 
-    list<weak_ptr<MapPoint>> getObservedMapPoints() {
+    vector<weak_ptr<MapPoint>> getObservedMapPoints() {
         unique_lock<mutex> lck(observationMutex_);
         return observedMapPoints_;
     }
 
 private: 
-    static unsigned long factoryId_;
     unsigned long               id_;         // id of this frame
 
-    mutex poseMutex_;
-    SE3                         T_c_w_;      // transform from world to camera
+    SeqLock<SE3>                T_c_w_;      // transform from world to camera
 
     mutex observationMutex_;
-    mutex connectedMutex_;
-    // Connected keyframes (has same observed mappoints >= 15) and the number of mappoints
-    ConnectedKeyFrameIdToWeight connectedKeyFrameIdToWeight_;
 
-    list<weak_ptr<MapPoint>> observedMapPoints_;
+    vector<weak_ptr<MapPoint>> observedMapPoints_;
+
+    // keypoint indices in each grid cell, row major
+    int gridCellSize_, gridCols_, gridRows_;
+    vector<vector<size_t>> keyPointGrid_;
 };
 
 }
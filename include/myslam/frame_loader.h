@@ -0,0 +1,72 @@
+#ifndef MYSLAM_FRAME_LOADER_H
+#define MYSLAM_FRAME_LOADER_H
+
+#include "myslam/common_include.h"
+#include "myslam/camera.h"
+#include "myslam/frame.h"
+#include "myslam/depth_preprocessor.h"
+
+namespace myslam {
+
+/*
+  Bounded producer/consumer frame source for the TUM associate.txt list.
+  Worker threads decode the rgb/depth images at most prefetchFrames_ entries
+  ahead of the consumer, next() hands out the frames in dataset order.
+  The depth images are preprocessed on the same threads.
+*/
+class FrameLoader {
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+    typedef std::shared_ptr<FrameLoader> Ptr;
+
+    // the frames are numbered from firstFrameId in dataset order
+    FrameLoader(const string& datasetDir, const Camera::Ptr& camera, const unsigned long firstFrameId = 0);
+
+    ~FrameLoader() { Stop(); }
+
+    // false if the associate file cannot be read
+    bool isOpened() const { return opened_; }
+
+    size_t size() const { return rgbFiles_.size(); }
+
+    void Stop();
+
+    /*
+      Block until the next frame is decoded.
+      Return nullptr at the end of the sequence or if an image cannot be read.
+    */
+    Frame::Ptr next();
+
+private:
+    struct DecodedImages {
+        Mat color, depth;
+        Mat depthMeters;
+    };
+
+    bool opened_;
+    Camera::Ptr camera_;
+    vector<string> rgbFiles_, depthFiles_;
+    vector<double> rgbTimes_;
+    unsigned long firstFrameId_;
+
+    int prefetchFrames_;    // max number of decoded frames waiting for the consumer
+
+    DepthPreprocessor::Ptr depthPreprocessor_;
+
+    bool loaderRunning_;
+    vector<thread> loaderThreads_;
+    mutex loaderMutex_;
+    condition_variable slotFree_;       // consumer took a frame
+    condition_variable frameReady_;     // worker finished a frame
+
+    size_t nextToDecode_;               // next index taken by a worker
+    size_t nextToDeliver_;              // next index returned by next()
+    unordered_map<size_t, DecodedImages> decoded_;
+
+    void loaderLoop();
+
+}; // class FrameLoader
+
+} // namespace
+
+#endif  // MYSLAM_FRAME_LOADER_H
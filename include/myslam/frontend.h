@@ -8,13 +8,23 @@
 #include <opencv2/features2d/features2d.hpp>
 #include <bits/stdc++.h>
 #include "myslam/common_include.h"
-#include "myslam/viewer.h"
 #include "myslam/frame.h"
+#include "myslam/map.h"
 #include "myslam/backend.h"
+#include "myslam/feature_extractor.h"
+#include "myslam/pose_optimizer.h"
+#include "myslam/pnp_ransac.h"
+#include "myslam/motion_model.h"
+#include "myslam/direct_tracker.h"
+#include "myslam/optical_flow_tracker.h"
+#include "myslam/latency_controller.h"
 #include "myslam/util.h"
 
 namespace myslam 
 {
+// only defined when built with MYSLAM_WITH_VIEWER
+class Viewer;
+
 class FrontEnd
 {
 public:
@@ -25,31 +35,63 @@ public:
         TRACKING=0,
         LOST
     };
+    enum TrackingMode {
+        TRACKING_FEATURES=0,    // ORB matching and PnP on every frame
+        TRACKING_DIRECT=1,      // dense RGB-D alignment, features only at the keyframes
+        TRACKING_FLOW=2         // KLT of the reference keypoints and PnP, features only at the keyframes
+    };
     
-    FrontEnd();
+    // tracks into map, which is only shared with the backend and the viewer of the same session
+    explicit FrontEnd(const Map::Ptr& map);
     
     bool addFrame( Frame::Ptr frame );      // add a new frame 
 
-    void setViewer(Viewer::Ptr viewer) {viewer_ = viewer;}
+    void setViewer(shared_ptr<Viewer> viewer) {viewer_ = viewer;}
 
     void setBackend(Backend::Ptr backend) {backend_ = backend;}
 
+    // wait for the backend after each keyframe, the results then do not depend on the timing
+    void setBackendSync(bool sync) {backendSync_ = sync;}
+
+    // override latency_control, without it the settings do not depend on the timing
+    void setLatencyControl(bool enable) {
+        latencyController_ = enable ? LatencyController::Ptr(new LatencyController) : nullptr;
+    }
+
+    // the extraction stage, can be started as a pipeline ahead of addFrame
+    FeatureExtractor::Ptr getFeatureExtractor() { return extractor_; }
+
+    // whether every frame needs features, otherwise they are extracted on demand
+    // at the keyframes and the extraction should not be pipelined
+    bool extractsEveryFrame() const { return trackingMode_ == TRACKING_FEATURES; }
+
     VOState getState() { return state_;}
     
 private:  
+    Map::Ptr    map_;
     Frame::Ptr  frameRef_;       // reference key frame
     Frame::Ptr  frameCurr_;      // current frame 
     VOState     state_;     // current VO status
-    cv::Ptr<cv::ORB> orb_;  // orb detector and computer 
+    FeatureExtractor::Ptr extractor_;  // orb detector and computer 
     vector<cv::KeyPoint>    keypointsCurr_;    // keypoints in current frame
     Mat                     descriptorsCurr_;  // descriptor in current frame 
-    cv::FlannBasedMatcher   flannMatcher_;     // flann matcher
     unordered_map<MapPoint::Ptr, cv::KeyPoint>  matchedMptKptMap_;   // matched map points and keypoints
     KeyPointSet  matchedKptSet_; // set of matched keypoint
    
     SE3 estimatedPoseCurr_;    // the estimated pose of current frame 
+    MotionModel motionModel_;  // predicts the initial pose of current frame
+
+    ProjectionBatch projectionBatch_;           // candidates projected for guided matching, reused every frame
+    PnPRansac::Ptr pnpRansac_;                  // initial pose from the matches
+    PoseOptimizer::Ptr poseOptimizer_;          // motion-only BA
+    PoseCorrespondences poseCorrespondences_;   // matched mappoints and keypoints, reused every frame
+    vector<uchar> poseInliers_;                 // inlier mask of poseCorrespondences_
+    DirectTracker::Ptr directTracker_;          // nullptr unless tracking_mode is TRACKING_DIRECT
+    OpticalFlowTracker::Ptr flowTracker_;       // nullptr unless tracking_mode is TRACKING_FLOW
+    LatencyController::Ptr latencyController_;  // nullptr unless latency_control is set
  
     int num_inliers_;        // number of inlier features in pnp
+    bool poseFromPnP_;       // num_inliers_ was computed for current frame
     int accuLostFrameNums_;           // number of lost times
     
     // parameters, see config/default.yaml
@@ -58,11 +100,46 @@ private:
     int min_inliers_;       // minimum inliers
     double keyFrameMinRot_;   // minimal rotation of two key-frames
     double keyFrameMinTrans_; // minimal translation of two key-frames
+    double keyFrameSpacing_;  // factor of the two above set by the latency controller
+    bool guidedMatching_;     // match by projection of the mappoints instead of brute-force matching
+    int keyPointGridSize_;    // cell size of the keypoint grid for guided matching
+    float guidedSearchRadius_;  // search window around the projection of a mappoint
+    int guidedMaxDistance_;   // max hamming distance of a guided match
+    float guidedMatchRatio_;  // ratio between the best and second best distance in the window
+    int guidedMinMatches_;    // fall back to brute-force matching below this number of guided matches
+    bool useMotionModel_;     // start from the constant velocity prediction instead of the reference keyframe pose
+    float predictedSearchRadius_;  // guided search window when the pose is predicted with the velocity
+    float searchRadius_;      // guided search window of current frame
+    TrackingMode trackingMode_;
+    float directKeyFrameRatio_;  // new keyframe when fewer of the reference pixels are in view
+    float flowKeyFrameRatio_;    // new keyframe when fewer of the reference keypoints are tracked inliers
     
     // inner operation 
+    // the tracking of addFrame
+    bool trackFrame();
+    // hand the time of the frame to the latency controller and apply its budget
+    void adaptToLatency(const double frameMs);
+    // set the initial pose of current frame from the motion model
+    void predictPose();
+    // track current frame against the reference keyframe without features, the pose goes
+    // to estimatedPoseCurr_, lowOverlap is set when a new keyframe is needed
+    bool trackDirect(bool& lowOverlap);
+    bool trackOpticalFlow(bool& lowOverlap);
+    // the new reference keyframe of the trackers above
+    void setTrackingReference();
+    // set a tracked pose to current frame, update the motion model and cull the mappoints
+    void acceptPose(const SE3& pose);
     void extractKeyPointsAndComputeDescriptors();
     void computeDescriptors(); 
     void matchKeyPointsWithActiveMapPoints();
+    // search the keypoints around the projection of each mappoint candidate with the current pose
+    void matchByProjection(const vector<MapPoint::Ptr>& mptCandidates, vector<cv::DMatch>& matches);
+    // compare each mappoint candidate with all keypoints
+    void matchBruteForce(const vector<MapPoint::Ptr>& mptCandidates, vector<cv::DMatch>& matches);
+    // keep the brute-force matches close to the best distance
+    void selectGoodMatches(vector<cv::DMatch>& matches);
+    // localize the first frame in a loaded map
+    bool relocalize();
     void estimatePosePnP(); 
 
     // for first key-frame, add all 3d points into map
@@ -81,11 +158,14 @@ private:
     void triangulateActiveMapPoints();
     
     bool isGoodEstimation(); 
+    // whether estimatedPoseCurr_ is close enough to the reference keyframe
+    bool isSmallMotion();
     bool isKeyFrame();
 
-    Viewer::Ptr viewer_;
+    shared_ptr<Viewer> viewer_;      // nullptr when running headless
 
     Backend::Ptr backend_;
+    bool backendSync_;
 
 };
 }
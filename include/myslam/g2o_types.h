@@ -58,46 +58,6 @@ class VertexPose : public g2o::BaseVertex<6, SE3> {
     virtual bool write(std::ostream &out) const override { return true; }
 };
 
-// edge for pose vertex, not optimize the mappoint
-class UnaryEdgeProjection : public g2o::BaseUnaryEdge<2, Vector2d, VertexPose>
-{
-public:
-    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
-
-    UnaryEdgeProjection(const Vector3d &pos, const Camera::Ptr& camera) : _mappointPos(pos), _camera(camera) {}
-
-    virtual void computeError() override
-    {
-        const VertexPose *v = static_cast<VertexPose *> (_vertices[0]);
-        SE3 T = v->estimate();
-        _error = _measurement - _camera->camera2pixel(T * _mappointPos);
-    }
-
-    virtual void linearizeOplus() override
-    {
-        const VertexPose *v = static_cast<VertexPose *> (_vertices[0]);
-        SE3 T = v->estimate();
-        Vector3d pos_cam = T * _mappointPos;
-        double fx = _camera->fx_;
-        double fy = _camera->fy_;
-        double X = pos_cam[0];
-        double Y = pos_cam[1];
-        double Z = pos_cam[2];
-        double Zinv = 1.0 / (Z + 1e-18);
-        double Zinv2 = Zinv * Zinv;
-        _jacobianOplusXi
-        << -fx * Zinv, 0, fx * X * Zinv2, fx * X * Y * Zinv2, -fx - fx * X * X * Zinv2, fx * Y * Zinv,
-        0, -fy * Zinv, fy * Y / (Z * Z), fy + fy * Y * Y * Zinv2, -fy * X * Y * Zinv2, -fy * X * Zinv;
-        }
-
-        virtual bool read( std::istream& in ) override {}
-        virtual bool write(std::ostream& os) const override {}
-
-private:
-    Vector3d _mappointPos;
-    Camera::Ptr _camera;
-};
-
 /// Vertex for mappoint
 class VertexMappoint : public g2o::BaseVertex<3, Vector3d> {
    public:
@@ -115,38 +75,33 @@ class VertexMappoint : public g2o::BaseVertex<3, Vector3d> {
     virtual bool write(std::ostream &out) const override { return true; }
 };
 
-// edge for pose vertex and mappoint vertex
-class BinaryEdgeProjection : public g2o::BaseBinaryEdge<2, Vector2d, VertexPose, VertexMappoint> {
+// the base of the BinaryEdgeProjection of every camera model
+typedef g2o::BaseBinaryEdge<2, Vector2d, VertexPose, VertexMappoint> ProjectionEdge;
+
+// edge for pose vertex and mappoint vertex, specialized on the camera model
+template<class Model>
+class BinaryEdgeProjection : public ProjectionEdge {
    public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
 
-    BinaryEdgeProjection(const Camera::Ptr& camera) : _camera(camera) { }
+    explicit BinaryEdgeProjection(const Model& model) : _model(model) { }
 
     virtual void computeError() override {
         const VertexPose *v0 = static_cast<VertexPose *>(_vertices[0]);
         const VertexMappoint *v1 = static_cast<VertexMappoint *>(_vertices[1]);
-        SE3 T = v0->estimate();
-        _error = _measurement - _camera->camera2pixel(T * v1->estimate());
+        _error = _measurement - _model.project(v0->estimate() * v1->estimate());
     }
 
     virtual void linearizeOplus() override {
         const VertexPose *v0 = static_cast<VertexPose *>(_vertices[0]);
         const VertexMappoint *v1 = static_cast<VertexMappoint *>(_vertices[1]);
-        SE3 T = v0->estimate();
-        Vector3d pos_world = v1->estimate();
-        Vector3d pos_cam = T * pos_world;
-        double fx = _camera->fx_;
-        double fy = _camera->fy_;
-        double X = pos_cam[0];
-        double Y = pos_cam[1];
-        double Z = pos_cam[2];
-        double Zinv = 1.0 / (Z + 1e-18);
-        double Zinv2 = Zinv * Zinv;
-        _jacobianOplusXi 
-        << -fx * Zinv, 0, fx * X * Zinv2, fx * X * Y * Zinv2, -fx - fx * X * X * Zinv2, fx * Y * Zinv, 
-        0, -fy * Zinv, fy * Y * Zinv2, fy + fy * Y * Y * Zinv2, -fy * X * Y * Zinv2, -fy * X * Zinv;
-
-        _jacobianOplusXj = _jacobianOplusXi.block<2, 3>(0, 0) * T.rotationMatrix();
+        const SE3 T = v0->estimate();
+        // the jacobians of g2o are maps, the kernel fills a plain matrix
+        Eigen::Matrix<double, 2, 6> J;
+        projectPoseJacobian(_model, T * v1->estimate(), J);
+        _jacobianOplusXi = -J;
+
+        _jacobianOplusXj = -J.leftCols<3>() * T.rotationMatrix();
     }
 
     virtual bool read(std::istream &in) override { return true; }
@@ -154,7 +109,34 @@ class BinaryEdgeProjection : public g2o::BaseBinaryEdge<2, Vector2d, VertexPose,
     virtual bool write(std::ostream &out) const override { return true; }
 
    private:
-    Camera::Ptr _camera;
+    Model _model;
+};
+
+// projection edge with the model of camera, chosen once per edge
+inline ProjectionEdge* createProjectionEdge(const Camera& camera) {
+    if (camera.hasDistortion()) {
+        return new BinaryEdgeProjection<RadialTangentialModel<double>>(camera.getRadialTangential());
+    }
+    return new BinaryEdgeProjection<PinholeModel<double>>(camera.getPinhole());
+}
+
+// prior on a mappoint position, marginalized from the observations of retired keyframes
+class UnaryEdgePointPrior : public g2o::BaseUnaryEdge<3, Vector3d, VertexMappoint> {
+   public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+
+    virtual void computeError() override {
+        const VertexMappoint *v = static_cast<VertexMappoint *>(_vertices[0]);
+        _error = _measurement - v->estimate();
+    }
+
+    virtual void linearizeOplus() override {
+        _jacobianOplusXi = -Eigen::Matrix3d::Identity();
+    }
+
+    virtual bool read(std::istream &in) override { return true; }
+
+    virtual bool write(std::ostream &out) const override { return true; }
 };
 
 
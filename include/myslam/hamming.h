@@ -0,0 +1,82 @@
+#ifndef MYSLAM_HAMMING_H
+#define MYSLAM_HAMMING_H
+
+#include <cstring>
+#include "myslam/common_include.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+namespace myslam {
+
+/**
+ * hamming distance of two 256-bit ORB descriptors
+ * uses AVX2 or NEON popcount when the target supports it (-march=native)
+ */
+inline int hammingDistance(const uchar* a, const uchar* b) {
+#if defined(__AVX2__)
+    const __m256i lookup = _mm256_setr_epi8(
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i lowMask = _mm256_set1_epi8(0x0f);
+    __m256i x = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a)),
+                                 _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b)));
+    __m256i lo = _mm256_and_si256(x, lowMask);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(x, 4), lowMask);
+    __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo), _mm256_shuffle_epi8(lookup, hi));
+    // horizontal sum of the byte counts into four 64-bit lanes
+    __m256i sum = _mm256_sad_epu8(cnt, _mm256_setzero_si256());
+    return _mm256_extract_epi64(sum, 0) + _mm256_extract_epi64(sum, 1)
+         + _mm256_extract_epi64(sum, 2) + _mm256_extract_epi64(sum, 3);
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    uint8x16_t c0 = vcntq_u8(veorq_u8(vld1q_u8(a), vld1q_u8(b)));
+    uint8x16_t c1 = vcntq_u8(veorq_u8(vld1q_u8(a + 16), vld1q_u8(b + 16)));
+    uint16x8_t s = vpaddlq_u8(vaddq_u8(c0, c1));
+    uint64x2_t s64 = vpaddlq_u32(vpaddlq_u16(s));
+    return int(vgetq_lane_u64(s64, 0) + vgetq_lane_u64(s64, 1));
+#else
+    int dist = 0;
+    for (int i = 0; i < 32; i += 8) {
+        uint64_t va, vb;
+        memcpy(&va, a + i, 8);
+        memcpy(&vb, b + i, 8);
+        dist += __builtin_popcountll(va ^ vb);
+    }
+    return dist;
+#endif
+}
+
+/**
+ * brute-force search of a descriptor in contiguous rows of descriptors
+ * @param query     the descriptor to search
+ * @param train     first row of the train descriptors
+ * @param step      bytes between two rows of train
+ * @param n         number of train descriptors
+ * @param bestDist  distance of the best match, 256 if n is 0
+ * @param secondDist distance of the second best match
+ * @return index of the best match, -1 if n is 0
+ */
+inline int searchBestMatch(const uchar* query, const uchar* train, const size_t step, const int n,
+                           int& bestDist, int& secondDist) {
+    int bestIdx = -1;
+    bestDist = 256;
+    secondDist = 256;
+    for (int i = 0; i < n; i++) {
+        int dist = hammingDistance(query, train + i * step);
+        if (dist < bestDist) {
+            secondDist = bestDist;
+            bestDist = dist;
+            bestIdx = i;
+        } else if (dist < secondDist) {
+            secondDist = dist;
+        }
+    }
+    return bestIdx;
+}
+
+} // namespace
+
+#endif  // MYSLAM_HAMMING_H
@@ -0,0 +1,68 @@
+#ifndef MYSLAM_LATENCY_CONTROLLER_H
+#define MYSLAM_LATENCY_CONTROLLER_H
+
+#include "myslam/common_include.h"
+
+namespace myslam {
+
+/*
+  Scales the tracking work to keep the frame time under a deadline.
+  The smoothed frame time is compared with the deadline every adaptInterval_
+  frames: above it the budget scale shrinks in proportion, below
+  lowRatio_ * deadline it grows back to the configured settings. The scale
+  sets the ORB feature count, the pyramid levels, the RANSAC iterations and
+  the spacing between the keyframes. With few inliers the budget is not
+  lowered but raised, the tracking quality goes before the latency.
+*/
+class LatencyController {
+public:
+    typedef std::shared_ptr<LatencyController> Ptr;
+
+    struct Budget {
+        int numFeatures;
+        int numLevels;
+        int ransacIterations;
+        double keyFrameSpacing;     // factor of the keyframe rotation and translation, >= 1
+    };
+
+    // the inliers of a frame tracked without correspondences
+    static const int NO_INLIERS = -1;
+
+    LatencyController();
+
+    /*
+      @param frameMs  wall time of the frame
+      @param inliers  pose inliers of the frame, 0 if the tracking failed, NO_INLIERS
+                      skips the quality guard
+      @return true if the budget has changed
+    */
+    bool update(const double frameMs, const int inliers);
+
+    const Budget& getBudget() const { return budget_; }
+
+    double getScale() const { return scale_; }
+
+private:
+    // parameters, see config/default.yaml
+    double deadlineMs_;
+    double smoothing_;          // weight of the new frame in the smoothed frame time
+    double lowRatio_;           // raise the budget below this fraction of the deadline
+    int adaptInterval_;         // frames between two changes
+    double minScale_;
+    int minInliers_;            // the guarded tracking quality, min_inliers * latency_inlier_margin
+    int minLevels_;
+    double maxKeyFrameSpacing_;
+
+    Budget base_;               // the configured settings, at scale 1
+    Budget budget_;
+    double scale_;
+    double smoothedMs_;         // 0 before the first frame
+    int framesSinceChange_;
+
+    void setScale(const double scale);
+
+}; // class LatencyController
+
+} // namespace
+
+#endif  // MYSLAM_LATENCY_CONTROLLER_H
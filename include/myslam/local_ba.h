@@ -0,0 +1,87 @@
+#ifndef MYSLAM_LOCAL_BA_H
+#define MYSLAM_LOCAL_BA_H
+
+#include "myslam/common_include.h"
+#include "myslam/camera.h"
+#include "myslam/frame.h"
+#include "myslam/mappoint.h"
+#include "myslam/g2o_types.h"
+#include "myslam/map.h"
+
+namespace myslam {
+
+/*
+  Persistent g2o problem of the local bundle adjustment.
+  Between two keyframes only the vertices and edges that entered or left the
+  window are added or removed, the others are kept with their last solution.
+  In non incremental mode the graph is rebuilt from scratch on every window.
+  Only used by the backend passes, one at a time.
+*/
+class LocalBundleAdjustment {
+public:
+    typedef std::shared_ptr<LocalBundleAdjustment> Ptr;
+
+    LocalBundleAdjustment(const Map::Ptr& map, const Camera::Ptr& camera, const float chi2Th, const bool incremental);
+
+    /*
+      Move the graph to a new window. The keyframes of the window are optimized,
+      the other keyframes observing their mappoints are fixed.
+    */
+    void setWindow(const unordered_set<unsigned long>& windowKeyFrameIds);
+
+    /*
+      Two rounds of optimization with outlier rejection, then write back the results.
+      @param updatedKeyFrames   out: the keyframes whose pose has been written back
+      @param updatedMapPoints   out: the mappoints whose position has been written back
+    */
+    void optimize(vector<Frame::Ptr>& updatedKeyFrames, vector<MapPoint::Ptr>& updatedMapPoints);
+
+    void clear();
+
+private:
+    typedef pair<unsigned long, unsigned long> EdgeKey;     // keyframe id, mappoint id
+
+    struct EdgeKeyHash {
+        size_t operator()(const EdgeKey& key) const {
+            return std::hash<unsigned long>()(key.first) * 31 + std::hash<unsigned long>()(key.second);
+        }
+    };
+
+    struct PoseNode {
+        VertexPose* vertex;
+        Frame::Ptr keyFrame;
+    };
+
+    struct PointNode {
+        VertexMappoint* vertex;
+        MapPoint::Ptr mapPoint;
+        UnaryEdgePointPrior* prior;     // nullptr if the mappoint has no prior
+    };
+
+    struct EdgeNode {
+        ProjectionEdge* edge;
+        Frame::Ptr keyFrame;
+        MapPoint::Ptr mapPoint;
+    };
+
+    Map::Ptr map_;
+    Camera::Ptr camera_;
+    float chi2Th_;
+    bool incremental_;
+
+    g2o::SparseOptimizer optimizer_;
+    int nextVertexId_;
+    int nextEdgeId_;
+
+    unordered_map<unsigned long, PoseNode> poses_;
+    unordered_map<unsigned long, PointNode> points_;
+    unordered_map<EdgeKey, EdgeNode, EdgeKeyHash> edges_;
+
+    LocalBundleAdjustment(const LocalBundleAdjustment&);
+    LocalBundleAdjustment& operator=(const LocalBundleAdjustment&);
+
+}; // class LocalBundleAdjustment
+
+} // namespace
+
+#endif  // MYSLAM_LOCAL_BA_H
@@ -20,13 +20,46 @@
 #ifndef MAP_H
 #define MAP_H
 
+#include <deque>
 #include "myslam/common_include.h"
 #include "myslam/frame.h"
 #include "myslam/mappoint.h"
 #include "myslam/config.h"
+#include "myslam/voxel_index.h"
 
 namespace myslam
 {
+
+/*
+  Read-only view of a dictionary of the map.
+  The view is rebuilt at most once per modification of the dictionary, all the
+  readers in between share the same immutable copy and iterate it without lock.
+  Only used with the data mutex of the map held.
+*/
+template <class Dict>
+class SnapshotCache
+{
+public:
+    typedef shared_ptr<const Dict> View;
+
+    SnapshotCache() : dirty_(true) {}
+
+    // the writer changed the dictionary
+    void invalidate() { dirty_ = true; }
+
+    const View& get(const Dict& dict) {
+        if (dirty_) {
+            view_ = View(new Dict(dict));
+            dirty_ = false;
+        }
+        return view_;
+    }
+
+private:
+    bool dirty_;
+    View view_;
+};
+
 class Map
 {
 public:
@@ -34,18 +67,38 @@ public:
     typedef shared_ptr<Map> Ptr;
     typedef unordered_map<unsigned long, MapPoint::Ptr > MappointDict;
     typedef unordered_map<unsigned long, Frame::Ptr > KeyframeDict;
+    typedef SnapshotCache<MappointDict>::View MappointSnapshot;
+    typedef SnapshotCache<KeyframeDict>::View KeyframeSnapshot;
+    typedef pair<double, SE3> StampedPose;
+    typedef vector<StampedPose, Eigen::aligned_allocator<StampedPose>> Trajectory;
 
-    static Map& getInstance() {
-        static Map map_;
-        return map_;
+    Map() {   
+        mapPointEraseRatio_ = Config::get<double> ( "map_point_erase_ratio" );
+        slidingWindowSize_ = Config::get<int> ( "sliding_window_size" );
+        nextFrameId_ = 0;
+        nextMapPointId_ = 0;
+        descriptorPool_ = DescriptorPool::Ptr(new DescriptorPool);
+        covisibility_ = CovisibilityGraph::Ptr(new CovisibilityGraph(
+            Config::get<int> ( "covisibility_min_weight" )));
+        voxelIndex_ = VoxelIndex::Ptr(new VoxelIndex(
+            Config::get<double> ( "voxel_size" ),
+            Config::get<double> ( "frustum_max_depth" )));
     }
     
     void insertKeyFrame( const Frame::Ptr& frame );
     void insertMapPoint( const MapPoint::Ptr& map_point );
 
+    // set the position of a mappoint and keep the spatial index in sync
+    void updateMapPointPosition( const MapPoint::Ptr& map_point, const Vector3d& pos );
+
+    // mappoints in the view of frame, found through the spatial index
+    vector<MapPoint::Ptr> getMappointsInView( const Frame::Ptr& frame, const bool activeOnly );
+
     void removeActiveMapPoint ( const unsigned long& id ) {
         unique_lock<mutex> lck(data_mutex_);
-        activeMapPoints_.erase(id);
+        if (activeMapPoints_.erase(id)) {
+            activeSnapshot_.invalidate();
+        }
     }
 
     // cull the hardly seen and no visible points of current frame from active mappoints
@@ -57,52 +110,104 @@ public:
                                     0.1;
     }
 
+    // nullptr if the keyframe does not exist or has left the sliding window
     shared_ptr<Frame> getKeyFrame(unsigned long id) {
-        // unique_lock<mutex> lck(data_mutex_);
-        if (keyFrames_.count(id)) {
-            return keyFrames_[id];
+        unique_lock<mutex> lck(data_mutex_);
+        auto iter = keyFrames_.find(id);
+        if (iter != keyFrames_.end()) {
+            return iter->second;
         } else {
             return nullptr;
         }
     }
 
-    KeyframeDict getAllKeyFrames() {
+    // timestamps and poses of all the keyframes, including the retired ones, by id
+    Trajectory getTrajectory();
+
+    // immutable snapshots, shared by all the readers until the map is modified
+    KeyframeSnapshot getAllKeyFrames() {
         unique_lock<mutex> lck(data_mutex_);
-        return keyFrames_;
+        return keyFramesSnapshot_.get(keyFrames_);
     }
-    MappointDict getAllMappoints() {
+    MappointSnapshot getAllMappoints() {
         unique_lock<mutex> lck(data_mutex_);
-        return mapPoints;
+        return mapPointsSnapshot_.get(mapPoints);
     }
 
-    MappointDict getActiveMappoints() {
+    MappointSnapshot getActiveMappoints() {
         unique_lock<mutex> lck(data_mutex_);
-        return activeMapPoints_;
+        return activeSnapshot_.get(activeMapPoints_);
     }
 
+    size_t getActiveMappointsSize() {
+        unique_lock<mutex> lck(data_mutex_);
+        return activeMapPoints_.size();
+    }
+
+    // storage of the descriptors of all mappoints
+    DescriptorPool::Ptr getDescriptorPool() { return descriptorPool_; }
+
+    CovisibilityGraph::Ptr getCovisibilityGraph() { return covisibility_; }
+
     void resetActiveMappoints() {
         unique_lock<mutex> lck(data_mutex_);
         activeMapPoints_ = mapPoints;
+        activeSnapshot_.invalidate();
     }
 
-private:
-    Map() {   
-        mapPointEraseRatio_ = Config::get<double> ( "map_point_erase_ratio" );
-    }
-    ~Map() {
-        
+    // ids are only unique within a map, each map numbers its own mappoints
+    unsigned long createMapPointId() { return nextMapPointId_++; }
+
+    // first id free for the frames of a new sequence, above the ids of all the keyframes ever inserted
+    unsigned long getNextFrameId() {
+        unique_lock<mutex> lck(data_mutex_);
+        return nextFrameId_;
     }
 
+private:
     mutex data_mutex_;
 
+    unsigned long nextFrameId_;                 // guarded by data_mutex_
+    atomic<unsigned long> nextMapPointId_;
+
     MappointDict  mapPoints;        // all mappoints
-    KeyframeDict  keyFrames_;         // all key-frames
+    KeyframeDict  keyFrames_;         // all key-frames in the sliding window
+    std::deque<unsigned long> keyFrameIds_; // ids of keyFrames_ in insertion order
+    Trajectory    retiredPoses_;      // the keyframes which left the sliding window
 
     MappointDict  activeMapPoints_;        // active mappoints, used for feature matching in frontend
 
+    SnapshotCache<MappointDict> mapPointsSnapshot_;
+    SnapshotCache<KeyframeDict> keyFramesSnapshot_;
+    SnapshotCache<MappointDict> activeSnapshot_;
+
     float mapPointEraseRatio_;
+    int slidingWindowSize_;     // max number of keyframes kept in the map, 0 for no limit
+
+    DescriptorPool::Ptr descriptorPool_;
+
+    CovisibilityGraph::Ptr covisibility_;   // keyframe observations of the mappoints
+
+    VoxelIndex::Ptr voxelIndex_;    // spatial index of all mappoints
+
+    ProjectionBatch projectionBatch_;   // reused by the view queries, guarded by data_mutex_
+
+    // positions and viewing directions of mapPoints into projectionBatch_
+    void fillProjectionBatch(const vector<MapPoint::Ptr>& mapPoints);
+
+    // take the oldest keyframes beyond the sliding window out of keyFrameIds_
+    vector<Frame::Ptr> popOldKeyframes( const Frame::Ptr& curr_frame );
+
+    /*
+      Retire a keyframe popped from the sliding window. Its observations are
+      marginalized into position priors of the mappoints, and the mappoints
+      no more observed by any keyframe leave the map.
+      @param observations  of the keyframe, copied before taking data_mutex_
+    */
+    void removeOldKeyframe( const Frame::Ptr& keyFrame, const vector<weak_ptr<MapPoint>>& observations );
 
-    void removeOldKeyframe( const Frame::Ptr& curr_frame);
+    Map(const Map&);
+    Map& operator=(const Map&);
 
 };
 
@@ -0,0 +1,103 @@
+#ifndef MYSLAM_MAP_IO_H
+#define MYSLAM_MAP_IO_H
+
+#include <cstdint>
+#include "myslam/common_include.h"
+#include "myslam/camera.h"
+#include "myslam/map.h"
+
+namespace myslam {
+
+/*
+  Binary map file, version 2, native byte order.
+
+    MapFileHeader
+    KeyFrameRecord[numKeyFrames]
+    MapPointRecord[numMapPoints]
+    descriptors, numMapPoints x 32 bytes, in the order of the mappoints
+    ObservationRecord[numObservations], grouped by mappoint
+
+  Every section starts at a 32 byte aligned offset of the file so it can be
+  used in place from a memory mapping. The covisibility weights are not
+  stored, the graph rebuilds them from the observations.
+*/
+struct MapFileHeader {
+    char magic[8];              // "MYSLAMAP"
+    uint32_t version;
+    uint32_t byteOrder;         // 0x01020304 written in native order
+    float fx, fy, cx, cy;       // camera of the keyframes
+    float k1, k2, p1, p2;       // its distortion coefficients
+    uint64_t numKeyFrames;
+    uint64_t numMapPoints;
+    uint64_t numObservations;
+    uint64_t keyFramesOffset;
+    uint64_t mapPointsOffset;
+    uint64_t descriptorsOffset;
+    uint64_t observationsOffset;
+    uint64_t fileSize;
+};
+
+struct KeyFrameRecord {
+    uint64_t id;
+    double timeStamp;
+    double translation[3];      // T_c_w
+    double rotation[4];         // T_c_w, quaternion x y z w
+};
+
+struct MapPointRecord {
+    uint64_t id;
+    double position[3];
+    double norm[3];
+    uint64_t firstObservation;  // index in the observations
+    uint64_t numObservations;
+};
+
+struct ObservationRecord {
+    uint64_t keyFrameId;
+    float u, v;                 // pixel in the keyframe
+};
+
+/*
+  Read-only memory mapping of a whole file.
+  Shared by the users of the memory, unmapped with the last one.
+*/
+class MappedFile {
+public:
+    typedef std::shared_ptr<MappedFile> Ptr;
+
+    // nullptr if the file cannot be mapped
+    static MappedFile::Ptr open(const string& path);
+
+    ~MappedFile();
+
+    const uchar* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const uchar* data_;
+    size_t size_;
+
+    MappedFile(const uchar* data, const size_t size) : data_(data), size_(size) {}
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+};
+
+class MapIO {
+public:
+    static const uint32_t VERSION = 2;
+
+    // write the keyframes and non outlier mappoints of the map
+    static bool save(const string& path, const Map::Ptr& map);
+
+    /*
+      Restore a saved map into the empty map. The descriptors are used in
+      place from the mapping of the file, the positions and observations,
+      which change while tracking, are copied.
+      @param camera  camera of the restored keyframes
+    */
+    static bool load(const string& path, const Camera::Ptr& camera, const Map::Ptr& map);
+};
+
+} // namespace
+
+#endif  // MYSLAM_MAP_IO_H
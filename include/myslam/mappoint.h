@@ -21,6 +21,10 @@
 #define MAPPOINT_H
 
 #include "myslam/common_include.h"
+#include "myslam/descriptor_pool.h"
+#include "myslam/covisibility_graph.h"
+#include "myslam/object_pool.h"
+#include "myslam/seqlock.h"
 
 namespace myslam
 {
@@ -31,7 +35,7 @@ class MapPoint
 public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
     typedef shared_ptr<MapPoint> Ptr;
-    typedef list<pair<unsigned long, cv::Point2f>> ObservedKFtoPixelPos;
+    typedef vector<pair<unsigned long, cv::Point2f>> ObservedKFtoPixelPos;
 
     // Usages
     // 1. whether match with new mappoints in front end
@@ -39,40 +43,59 @@ public:
     // 3. whether add new observation keyframe 
     // 4. whether update in co-visibility graph
     // 5. whether add into backend
-    bool        outlier_;               // whether this is an outlider
+    // flags and counters are shared with the backend, hence atomic
+    atomic<bool> outlier_;              // whether this is an outlider
 
-    bool        optimized_;             // whether is optimized by backend
+    atomic<bool> optimized_;            // whether is optimized by backend
 
-    bool        triangulated_;          // whether have been triangulated
+    atomic<bool> triangulated_;         // whether have been triangulated
     Vector3d    norm_;                  // Normal of viewing direction 
 
-    Mat         descriptor_;            // Descriptor for matching 
-    int         visibleTimes_;          // times should in the view of current frame, but maybe cannot be matched 
-    int         matchedTimes_;          // times of being an inliner in frontend P3P result
+    const uchar* descriptor_;           // Descriptor for matching, 32 bytes stored in the descriptor pool
+    atomic<int> visibleTimes_;          // times should in the view of current frame, but maybe cannot be matched 
+    atomic<int> matchedTimes_;          // times of being an inliner in frontend P3P result
     
-    // factory function
+    // factory function, the id comes from Map::createMapPointId
     static MapPoint::Ptr createMapPoint( 
+        const unsigned long id,
         const Vector3d posWorld, 
         const Vector3d norm,
         const Mat descriptor,
         const unsigned long observedKeyFrameId,
-        const cv::Point2f pixelPos);
-
-    Vector3d getPosition() {
-        unique_lock<mutex> lock(posMutex_);
-        return pos_;
+        const cv::Point2f pixelPos,
+        const DescriptorPool::Ptr& descriptorPool,
+        const CovisibilityGraph::Ptr& covisibility);
+
+    /*
+      Mappoint with a given id, e.g. loaded from a map file, without any observation.
+      @param descriptor  already stored in descriptorPool, used in place
+    */
+    static MapPoint::Ptr restoreMapPoint(
+        const unsigned long id,
+        const Vector3d& posWorld,
+        const Vector3d& norm,
+        const uchar* descriptor,
+        const DescriptorPool::Ptr& descriptorPool,
+        const CovisibilityGraph::Ptr& covisibility);
+
+    ~MapPoint();
+
+    Vector3d getPosition() const {
+        return pos_.load();
     }
 
+    // mappoints inserted into the map are moved by Map::updateMapPointPosition
     void setPosition(const Vector3d& pos) {
-        unique_lock<mutex> lock(posMutex_);
-        pos_ = pos;
+        pos_.store(pos);
     }
 
     unsigned long getId() { return id_; }
 
+    // the observations are mirrored into the covisibility graph of the map
     void addKeyFrameObservation(const unsigned long keyFrameId, const cv::Point2f& pixel_pos) {
         unique_lock<mutex> lock(observationMutex_);
         observedKeyFrameMap_.push_back(make_pair(keyFrameId, pixel_pos));
+        covisibility_->addObservation(keyFrameId, id_);
     }
 
     ObservedKFtoPixelPos getKeyFrameObservationsMap() {
@@ -82,24 +105,54 @@ public:
 
     void removeKeyFrameObservation(const unsigned long keyFrameId);
 
-private:
-    static unsigned long factoryId_;    // factory id
-    unsigned long      id_; // ID
+    // drop the observation of a keyframe leaving the sliding window, return the number of remaining ones
+    size_t retireKeyFrameObservation(const unsigned long keyFrameId);
 
-    mutex posMutex_;
-    Vector3d    pos_;       // Position in world
+    // fuse a gaussian prior on the position, marginalized from a retired observation
+    void addPositionPrior(const Vector3d& pos, const Eigen::Matrix3d& information);
 
-    mutex observationMutex_;
-    ObservedKFtoPixelPos observedKeyFrameMap_;
+    // return false if there is no prior
+    bool getPositionPrior(Vector3d& pos, Eigen::Matrix3d& information);
+
+private:
+    // only the factory can construct a mappoint, allocate_shared needs a public constructor
+    struct FactoryTag { explicit FactoryTag() {} };
 
-    // mappoint can only be created by factory
+public:
     MapPoint( 
+        const FactoryTag&,
         unsigned long id, 
         const Vector3d& position, 
         const Vector3d& norm, 
         const Mat& descriptor,
         const unsigned long observedKeyFrameId,
-        const cv::Point2f& pixelPos);
+        const cv::Point2f& pixelPos,
+        const DescriptorPool::Ptr& descriptorPool,
+        const CovisibilityGraph::Ptr& covisibility);
+
+    MapPoint(
+        const FactoryTag&,
+        unsigned long id,
+        const Vector3d& position,
+        const Vector3d& norm,
+        const uchar* pooledDescriptor,
+        const DescriptorPool::Ptr& descriptorPool,
+        const CovisibilityGraph::Ptr& covisibility);
+
+private:
+    DescriptorPool::Ptr descriptorPool_;    // owner of descriptor_
+    CovisibilityGraph::Ptr covisibility_;   // covisibility graph of the map
+    unsigned long      id_; // ID
+
+    SeqLock<Vector3d> pos_; // Position in world
+
+    mutex observationMutex_;
+    ObservedKFtoPixelPos observedKeyFrameMap_;
+
+    // prior on the position from the retired observations, guarded by observationMutex_
+    bool        hasPrior_;
+    Vector3d    priorPos_;
+    Eigen::Matrix3d priorInformation_;
 };
 
 } // namespace
@@ -0,0 +1,50 @@
+#ifndef MYSLAM_MOTION_MODEL_H
+#define MYSLAM_MOTION_MODEL_H
+
+#include "myslam/common_include.h"
+
+namespace myslam {
+
+/*
+  Constant velocity model of the camera.
+  The velocity is the twist between the last two tracked frames, scaled by
+  their timestamps so that dropped or irregular frames are extrapolated
+  correctly. Without valid timestamps one step per frame is assumed.
+*/
+class MotionModel {
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    MotionModel() : hasPose_(false), hasVelocity_(false), lastTime_(-1) {}
+
+    // forget the velocity, e.g. after a tracking failure, the last pose is kept
+    void reset() { hasVelocity_ = false; }
+
+    // a new tracked pose
+    void update(const double timeStamp, const SE3& T_c_w);
+
+    /*
+      Predicted pose at timeStamp, the last pose if the velocity is unknown.
+      @return true if the velocity was used
+    */
+    bool predict(const double timeStamp, SE3& T_c_w) const;
+
+    bool hasPose() const { return hasPose_; }
+
+private:
+    bool hasPose_;
+    bool hasVelocity_;
+    double lastTime_;
+    SE3 lastPose_;
+    Sophus::Vector6d velocity_;     // twist per second, or per frame without timestamps
+
+    // time between two frames in the unit of velocity_
+    static double elapsed(const double from, const double to) {
+        return (from >= 0 && to > from) ? to - from : 1.0;
+    }
+
+}; // class MotionModel
+
+} // namespace
+
+#endif  // MYSLAM_MOTION_MODEL_H
@@ -0,0 +1,118 @@
+#ifndef MYSLAM_OBJECT_POOL_H
+#define MYSLAM_OBJECT_POOL_H
+
+#include "myslam/common_include.h"
+
+namespace myslam {
+
+/*
+  Free list of fixed size blocks carved out of large slabs.
+  Released blocks are reused before a new slab is allocated and the slabs
+  are never returned, so objects created and culled all along a run do not
+  fragment the heap. One pool per block size and alignment, shared by all
+  the threads.
+*/
+template<size_t Size, size_t Align>
+class FixedSizePool
+{
+public:
+    // never destroyed, the blocks of shared pointers still alive during the static destruction
+    // are released after it
+    static FixedSizePool& getInstance() {
+        static FixedSizePool* instance = new FixedSizePool;
+        return *instance;
+    }
+
+    void* allocate() {
+        unique_lock<mutex> lck(mutex_);
+        if (freeList_ == nullptr) {
+            grow();
+        }
+        FreeBlock* block = freeList_;
+        freeList_ = block->next;
+        return block;
+    }
+
+    void release(void* p) {
+        unique_lock<mutex> lck(mutex_);
+        FreeBlock* block = static_cast<FreeBlock*>(p);
+        block->next = freeList_;
+        freeList_ = block;
+    }
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    // block size rounded up to the alignment, large enough for the free list link
+    static const size_t kAlign = (Align > alignof(FreeBlock)) ? Align : alignof(FreeBlock);
+    static const size_t kBlockSize = ((((Size > sizeof(FreeBlock)) ? Size : sizeof(FreeBlock)) + kAlign - 1) / kAlign) * kAlign;
+    static const size_t kBlocksPerSlab = 256;
+
+    // aligned_malloc returns at least 16 byte aligned memory
+    static_assert(kAlign <= 16, "the slabs are not aligned enough for this type");
+
+    mutex mutex_;
+    FreeBlock* freeList_;
+
+    FixedSizePool() : freeList_(nullptr) {}
+
+    // thread all the blocks of a new slab into the free list
+    void grow() {
+        char* slab = static_cast<char*>(Eigen::internal::aligned_malloc(kBlockSize * kBlocksPerSlab));
+        for (size_t i = kBlocksPerSlab; i > 0; i--) {
+            FreeBlock* block = reinterpret_cast<FreeBlock*>(slab + (i - 1) * kBlockSize);
+            block->next = freeList_;
+            freeList_ = block;
+        }
+    }
+
+    FixedSizePool(const FixedSizePool&);
+    FixedSizePool& operator=(const FixedSizePool&);
+};
+
+/*
+  Standard allocator over FixedSizePool, for allocate_shared: the object and
+  its shared_ptr control block come in a single block from the pool of their
+  combined type. Arrays fall back to the aligned heap.
+*/
+template<class T>
+class PoolAllocator
+{
+public:
+    typedef T value_type;
+
+    template<class U>
+    struct rebind { typedef PoolAllocator<U> other; };
+
+    PoolAllocator() {}
+
+    template<class U>
+    PoolAllocator(const PoolAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        if (n != 1) {
+            return static_cast<T*>(Eigen::internal::aligned_malloc(n * sizeof(T)));
+        }
+        return static_cast<T*>(FixedSizePool<sizeof(T), alignof(T)>::getInstance().allocate());
+    }
+
+    void deallocate(T* p, size_t n) {
+        if (n != 1) {
+            Eigen::internal::aligned_free(p);
+            return;
+        }
+        FixedSizePool<sizeof(T), alignof(T)>::getInstance().release(p);
+    }
+};
+
+template<class T, class U>
+inline bool operator==(const PoolAllocator<T>&, const PoolAllocator<U>&) { return true; }
+
+template<class T, class U>
+inline bool operator!=(const PoolAllocator<T>&, const PoolAllocator<U>&) { return false; }
+
+} // namespace
+
+#endif  // MYSLAM_OBJECT_POOL_H
@@ -0,0 +1,63 @@
+#ifndef MYSLAM_OPTICAL_FLOW_TRACKER_H
+#define MYSLAM_OPTICAL_FLOW_TRACKER_H
+
+#include "myslam/common_include.h"
+#include "myslam/frame.h"
+#include "myslam/mappoint.h"
+#include "myslam/pose_optimizer.h"
+
+namespace myslam {
+
+/*
+  Tracks the keypoints of the reference keyframe with pyramidal KLT, without
+  features in the tracked frames. Each frame is tracked from the reference
+  images, so the patches do not drift between the keyframes, and the search
+  starts at the projection of the mappoint with the initial pose of the frame.
+  The tracked keypoints keep their mappoint, the result is a set of 3D-2D
+  correspondences for PnPRansac and PoseOptimizer.
+*/
+class OpticalFlowTracker {
+public:
+    typedef std::shared_ptr<OpticalFlowTracker> Ptr;
+
+    OpticalFlowTracker();
+
+    // the keypoints of the keyframe observing a mappoint become the tracks
+    void setReference(const Frame::Ptr& keyFrame);
+
+    size_t getReferenceSize() const { return mapPoints_.size(); }
+
+    /*
+      Track the reference keypoints into frame.
+      @param corr  out: position of the mappoints and tracked pixels
+      @return number of tracked keypoints
+    */
+    int track(const Frame::Ptr& frame, PoseCorrespondences& corr);
+
+private:
+    int levels_;            // pyramid levels
+    int windowSize_;        // search window of each level, in pixel
+    int iterations_;        // max iterations per level
+
+    Frame::Ptr reference_;
+    vector<Mat> referencePyramid_;
+    vector<MapPoint::Ptr> mapPoints_;           // mappoint of each reference keypoint
+    vector<cv::Point2f> referencePixels_;
+
+    // pyramid of the last tracked frame, reused when it becomes the reference
+    Frame::Ptr lastFrame_;
+    vector<Mat> lastPyramid_;
+
+    // reused every frame
+    vector<cv::Point2f> trackedFrom_, trackedTo_;
+    vector<int> trackedIndex_;
+    vector<uchar> status_;
+    vector<float> error_;
+
+    void buildPyramid(const Frame::Ptr& frame, vector<Mat>& pyramid) const;
+
+}; // class OpticalFlowTracker
+
+} // namespace
+
+#endif  // MYSLAM_OPTICAL_FLOW_TRACKER_H
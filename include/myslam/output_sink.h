@@ -0,0 +1,72 @@
+#ifndef MYSLAM_OUTPUT_SINK_H
+#define MYSLAM_OUTPUT_SINK_H
+
+#include <fstream>
+#include "myslam/common_include.h"
+#include "myslam/frame.h"
+#include "myslam/mappoint.h"
+
+namespace myslam {
+
+/*
+  Streams the results while running, one line per record:
+
+    F timestamp frame_id tx ty tz qx qy qz qw      tracked frame pose (T_c_w)
+    K timestamp keyframe_id tx ty tz qx qy qz qw   keyframe pose after a backend pass
+    P mappoint_id x y z                            mappoint position after a backend pass
+    B keyframe_id                                  end of the deltas of a backend pass
+
+  The producers only copy the values into a queue, the formatting and the
+  file writes happen on the writer thread. Thread-safe.
+*/
+class OutputSink {
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+    typedef std::shared_ptr<OutputSink> Ptr;
+
+    explicit OutputSink(const string& path);
+
+    ~OutputSink() { Stop(); }
+
+    bool isOpened() const { return out_.is_open(); }
+
+    void writeFramePose(const Frame::Ptr& frame);
+
+    // deltas of one backend pass, then the end of pass record
+    void writeBackendPass(const unsigned long lastKeyFrameId,
+                          const vector<Frame::Ptr>& keyFrames,
+                          const vector<MapPoint::Ptr>& mapPoints);
+
+    // write all the queued records and stop the writer thread
+    void Stop();
+
+private:
+    struct Record {
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+        char type;
+        unsigned long id;
+        double timeStamp;
+        SE3 pose;               // F and K
+        Vector3d position;      // P
+    };
+    typedef vector<Record, Eigen::aligned_allocator<Record>> Records;
+
+    ofstream out_;
+
+    bool running_;
+    thread writerThread_;
+    mutex queueMutex_;          // guards queue_ and running_
+    condition_variable queueUpdate_;
+    Records queue_;
+
+    void push(Records& records);
+    void writerLoop();
+
+    OutputSink(const OutputSink&);
+    OutputSink& operator=(const OutputSink&);
+
+}; // class OutputSink
+
+} // namespace
+
+#endif  // MYSLAM_OUTPUT_SINK_H
@@ -0,0 +1,64 @@
+#ifndef MYSLAM_PNP_RANSAC_H
+#define MYSLAM_PNP_RANSAC_H
+
+#include "myslam/common_include.h"
+#include "myslam/camera.h"
+#include "myslam/pose_optimizer.h"
+
+namespace myslam {
+
+/*
+  PnP RANSAC seeded with a prior pose.
+  The prior (the pose the frame was initialized with) is scored first; when
+  its inlier ratio is already good enough no hypothesis is sampled at all.
+  Otherwise P3P hypotheses from minimal samples are evaluated in parallel
+  batches, and the number of iterations is updated after every batch from
+  the best inlier ratio so far.
+*/
+class PnPRansac {
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+    typedef std::shared_ptr<PnPRansac> Ptr;
+
+    PnPRansac();
+
+    /*
+      @param priorPose  first hypothesis
+      @param pose       out: best hypothesis
+      @param inliers    out: inlier mask of corr with the best hypothesis
+      @return number of inliers, 0 if no hypothesis has been found
+    */
+    int estimate(const PoseCorrespondences& corr, const Camera::Ptr& camera, const SE3& priorPose,
+                 SE3& pose, vector<uchar>& inliers);
+
+    // lower the iteration bound under a latency budget
+    void setMaxIterations(const int maxIterations) { maxIterations_ = max(1, maxIterations); }
+
+private:
+    int maxIterations_;         // upper bound of sampled hypotheses
+    int batchSize_;             // hypotheses evaluated in parallel at a time
+    double threshold2_;         // squared reprojection error of an inlier, in pixel
+    double confidence_;         // probability of sampling one outlier free minimal set
+    double priorInlierRatio_;   // accept the prior without sampling above this inlier ratio
+
+    // estimate() specialized on the camera model
+    template<class Model>
+    int estimateWith(const PoseCorrespondences& corr, const Model& model, const Mat& K, const Mat& distCoeffs,
+                     const SE3& priorPose, SE3& pose, vector<uchar>& inliers);
+
+    // number of inliers of a hypothesis
+    template<class Model>
+    int countInliers(const PoseCorrespondences& corr, const Model& model, const SE3& pose) const;
+
+    // P3P on 4 correspondences, the 4th one selects among the solutions
+    bool solveMinimal(const PoseCorrespondences& corr, const Mat& K, const Mat& distCoeffs,
+                      const int* sample, SE3& pose) const;
+
+    // hypotheses to draw to reach the confidence with this inlier ratio
+    int requiredIterations(const double inlierRatio) const;
+
+}; // class PnPRansac
+
+} // namespace
+
+#endif  // MYSLAM_PNP_RANSAC_H
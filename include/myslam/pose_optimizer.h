@@ -0,0 +1,78 @@
+#ifndef MYSLAM_POSE_OPTIMIZER_H
+#define MYSLAM_POSE_OPTIMIZER_H
+
+#include "myslam/common_include.h"
+#include "myslam/camera.h"
+
+namespace myslam {
+
+/*
+  3D-2D correspondences stored as struct of arrays.
+  clear() keeps the capacity, so a buffer reused every frame does not allocate.
+*/
+struct PoseCorrespondences {
+    vector<double> x, y, z;     // mappoint position in world
+    vector<double> u, v;        // matched keypoint in pixel
+
+    void clear() {
+        x.clear(); y.clear(); z.clear();
+        u.clear(); v.clear();
+    }
+
+    void add(const Vector3d& pos, const cv::Point2f& pixel) {
+        x.push_back(pos[0]); y.push_back(pos[1]); z.push_back(pos[2]);
+        u.push_back(pixel.x); v.push_back(pixel.y);
+    }
+
+    size_t size() const { return x.size(); }
+};
+
+/*
+  Motion-only bundle adjustment of a single pose.
+  Levenberg-Marquardt on the fixed size 6x6 normal equations with the
+  analytic jacobian, same parameterization as VertexPose (left
+  multiplication, translation first). Every round reclassifies all the
+  correspondences into inliers and outliers with the chi2 threshold, the
+  Huber kernel is used in all rounds but the last one. The inner loops are
+  specialized on the camera model, chosen once per call.
+*/
+class PoseOptimizer {
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+    typedef std::shared_ptr<PoseOptimizer> Ptr;
+
+    PoseOptimizer();
+
+    /*
+      Refine pose from its initial value.
+      @param inliers  in: correspondences used at the beginning, out: inliers after optimization
+      @return number of inliers
+    */
+    int optimize(const PoseCorrespondences& corr, const Camera::Ptr& camera,
+                 SE3& pose, vector<uchar>& inliers);
+
+private:
+    int iterations_;        // LM iterations per round
+    int rounds_;            // outlier reclassification rounds
+    double chi2Th_;         // chi2 threshold of an inlier, 2 dof
+    double huberDelta_;
+
+    template<class Model>
+    int optimizeWith(const PoseCorrespondences& corr, const Model& model,
+                     SE3& pose, vector<uchar>& inliers) const;
+
+    // accumulate the normal equations over the inliers, return the robust cost
+    template<class Model>
+    double buildNormalEquations(const PoseCorrespondences& corr, const Model& model,
+                                const SE3& pose, const vector<uchar>& inliers, const bool robust,
+                                Eigen::Matrix<double, 6, 6>& H, Eigen::Matrix<double, 6, 1>& b) const;
+
+    template<class Model>
+    double computeCost(const PoseCorrespondences& corr, const Model& model,
+                       const SE3& pose, const vector<uchar>& inliers, const bool robust) const;
+
+}; // class PoseOptimizer
+
+} // namespace
+
+#endif  // MYSLAM_POSE_OPTIMIZER_H
@@ -0,0 +1,152 @@
+#ifndef MYSLAM_PROFILER_H
+#define MYSLAM_PROFILER_H
+
+#include <chrono>
+#include <fstream>
+#include "myslam/common_include.h"
+
+namespace myslam {
+
+/*
+  Per frame stage timing and counters.
+  Each tracked frame gives one row of the CSV file, with the wall time of every
+  stage in ms and the counters. Every timed scope can also be written as a
+  complete event into a Chrome trace file (chrome://tracing or Perfetto).
+  Stages timed on other threads are attributed with the id of their frame,
+  or to the next row when that frame has already been written.
+  All calls are no-ops until open() is called.
+*/
+class Profiler {
+public:
+    enum Stage {
+        STAGE_TRACK = 0,            // the whole FrontEnd::addFrame
+        STAGE_EXTRACT,
+        STAGE_MATCH,
+        STAGE_PNP_RANSAC,
+        STAGE_MOTION_BA,
+        STAGE_CULLING,
+        STAGE_TRIANGULATION,
+        STAGE_BACKEND_OPTIMIZE,
+        STAGE_VIEWER_SYNC,
+        STAGE_DIRECT_ALIGN,
+        STAGE_OPTICAL_FLOW,
+        NUM_STAGES
+    };
+
+    enum Counter {
+        COUNTER_CANDIDATES = 0,     // mappoints in view used for matching
+        COUNTER_MATCHES,
+        COUNTER_INLIERS,
+        COUNTER_NEW_MAPPOINTS,
+        COUNTER_ACTIVE_MAPPOINTS,
+        COUNTER_FEATURE_BUDGET,     // ORB feature count of the latency controller
+        NUM_COUNTERS
+    };
+
+    static Profiler& getInstance() {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    // start recording, an empty traceFile disables the Chrome trace
+    void open(const string& csvFile, const string& traceFile);
+
+    // write the pending rows and close the files
+    void close();
+
+    bool isEnabled() const { return enabled_; }
+
+    // also keep the stage times of the written rows in memory, for getStageTimes()
+    void keepStageTimes(const bool keep) { keepStageTimes_ = keep; }
+
+    // time in ms of stage in each written row where it ran
+    vector<double> getStageTimes(const Stage stage);
+
+    static const char* getStageName(const Stage stage);
+
+    // the frame tracked by the frontend, stages and counters without frame id go to it
+    void beginFrame(const unsigned long frameId);
+
+    // write the row of the current frame
+    void endFrame();
+
+    // microseconds since open()
+    double now() const {
+        return std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - epoch_).count();
+    }
+
+    void addStageTime(const Stage stage, const double startUs, const double durationUs, const long frameId = -1);
+
+    void setCounter(const Counter counter, const long value);
+
+private:
+    struct FrameRecord {
+        double stageMs[NUM_STAGES];
+        long counters[NUM_COUNTERS];
+        FrameRecord() {
+            std::fill(stageMs, stageMs + NUM_STAGES, 0.0);
+            std::fill(counters, counters + NUM_COUNTERS, 0L);
+        }
+    };
+
+    Profiler() : enabled_(false), keepStageTimes_(false), currentFrame_(0), lastWritten_(-1), traceEvents_(0) {}
+    ~Profiler() { close(); }
+
+    atomic<bool> enabled_;
+    bool keepStageTimes_;
+    std::chrono::steady_clock::time_point epoch_;
+
+    mutex profilerMutex_;
+    long currentFrame_;
+    long lastWritten_;                  // id of the last row in the CSV file
+    std::map<long, FrameRecord> pendingFrames_;
+    unordered_map<thread::id, int> threadIds_;  // small thread ids for the trace
+
+    vector<double> stageTimes_[NUM_STAGES];
+
+    ofstream csv_;
+    ofstream trace_;
+    size_t traceEvents_;
+
+    // frame receiving a record of frameId, -1 is the current frame
+    FrameRecord& recordOf(const long frameId);
+
+    void writeRow(const long frameId, const FrameRecord& record);
+
+}; // class Profiler
+
+/*
+  Time a scope as a stage of the profiler.
+*/
+class ScopedTimer {
+public:
+    explicit ScopedTimer(const Profiler::Stage stage, const long frameId = -1)
+    : stage_(stage), frameId_(frameId), enabled_(Profiler::getInstance().isEnabled()), start_(0)
+    {
+        if (enabled_) {
+            start_ = Profiler::getInstance().now();
+        }
+    }
+
+    ~ScopedTimer() {
+        if (enabled_) {
+            Profiler& profiler = Profiler::getInstance();
+            profiler.addStageTime(stage_, start_, profiler.now() - start_, frameId_);
+        }
+    }
+
+private:
+    Profiler::Stage stage_;
+    long frameId_;
+    bool enabled_;
+    double start_;
+
+    ScopedTimer(const ScopedTimer&);
+    ScopedTimer& operator=(const ScopedTimer&);
+
+}; // class ScopedTimer
+
+} // namespace
+
+#endif  // MYSLAM_PROFILER_H
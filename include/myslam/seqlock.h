@@ -0,0 +1,75 @@
+#ifndef MYSLAM_SEQLOCK_H
+#define MYSLAM_SEQLOCK_H
+
+#include <cstring>
+#include "myslam/common_include.h"
+
+namespace myslam {
+
+/*
+  Sequence lock for small values shared between the frontend and the backend,
+  e.g. poses and mappoint positions.
+  Readers never block writers: they copy the value and retry when a write
+  happened meanwhile. Writers are serialized by the odd sequence number.
+  T has to be copyable with memcpy (Eigen fixed size types, Sophus SE3).
+*/
+template <class T>
+class SeqLock {
+public:
+    SeqLock() : seq_(0) { store(T()); }
+
+    explicit SeqLock(const T& value) : seq_(0) { store(value); }
+
+    T load() const {
+        uint64_t buf[WORDS];
+        while (true) {
+            unsigned seq = seq_.load(std::memory_order_acquire);
+            if (seq & 1) {
+                std::this_thread::yield();
+                continue;
+            }
+            for (int i = 0; i < WORDS; i++) {
+                buf[i] = words_[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq_.load(std::memory_order_relaxed) == seq) {
+                break;
+            }
+        }
+
+        T value;
+        memcpy(static_cast<void*>(&value), buf, sizeof(T));
+        return value;
+    }
+
+    void store(const T& value) {
+        uint64_t buf[WORDS] = {0};
+        memcpy(buf, static_cast<const void*>(&value), sizeof(T));
+
+        // an odd sequence number marks a write in progress
+        unsigned seq = seq_.load(std::memory_order_relaxed);
+        while ((seq & 1) || !seq_.compare_exchange_weak(seq, seq + 1, std::memory_order_acquire)) {
+            std::this_thread::yield();
+            seq = seq_.load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        for (int i = 0; i < WORDS; i++) {
+            words_[i].store(buf[i], std::memory_order_relaxed);
+        }
+        seq_.store(seq + 2, std::memory_order_release);
+    }
+
+private:
+    static const int WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    std::atomic<unsigned> seq_;
+    std::atomic<uint64_t> words_[WORDS];
+
+    SeqLock(const SeqLock&);
+    SeqLock& operator=(const SeqLock&);
+
+}; // class SeqLock
+
+} // namespace
+
+#endif  // MYSLAM_SEQLOCK_H
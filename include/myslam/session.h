@@ -0,0 +1,62 @@
+#ifndef MYSLAM_SESSION_H
+#define MYSLAM_SESSION_H
+
+#include "myslam/common_include.h"
+#include "myslam/camera.h"
+#include "myslam/map.h"
+#include "myslam/frontend.h"
+#include "myslam/backend.h"
+#include "myslam/frame_loader.h"
+
+namespace myslam {
+
+/*
+  One VO run over one sequence: its own map, frontend, backend and frame
+  source. Sessions only share the configuration and the process-wide pools
+  (OpenCV thread pool, object pools), so several sessions can track different
+  sequences or cameras in parallel in one process. Headless, the profiler
+  rows of parallel sessions would interleave, so it is left to single runs.
+*/
+class Session {
+public:
+    typedef std::shared_ptr<Session> Ptr;
+
+    Session(const string& datasetDir, const Camera::Ptr& camera);
+
+    ~Session() { Stop(); }
+
+    // false if the associate file cannot be read
+    bool isOpened() const { return loader_->isOpened(); }
+
+    /*
+      Track the whole sequence on the calling thread, then stop the threads of the session.
+      @return false if the tracking was lost
+    */
+    bool run();
+
+    // stop the extraction, loading and backend threads
+    void Stop();
+
+    Map::Ptr getMap() { return map_; }
+
+    FrontEnd::Ptr getFrontEnd() { return frontend_; }
+
+    // frames given to the frontend in run()
+    size_t getFrameCount() const { return frameCount_; }
+
+private:
+    Camera::Ptr camera_;
+    Map::Ptr map_;
+    FrontEnd::Ptr frontend_;
+    Backend::Ptr backend_;      // nullptr without local optimization
+    FrameLoader::Ptr loader_;
+    size_t frameCount_;
+
+    Session(const Session&);
+    Session& operator=(const Session&);
+
+}; // class Session
+
+} // namespace
+
+#endif  // MYSLAM_SESSION_H
@@ -0,0 +1,92 @@
+#ifndef MYSLAM_TASK_SCHEDULER_H
+#define MYSLAM_TASK_SCHEDULER_H
+
+#include <deque>
+#include <functional>
+#include "myslam/common_include.h"
+
+namespace myslam {
+
+/*
+  The worker threads shared by all the components of the process.
+  Every worker has one deque per priority: it takes its own newest task,
+  otherwise steals the oldest one of the other workers. The tracking tasks
+  always go before the background ones, and at most maxBackground_ workers
+  run background tasks at once so that the others stay free for tracking.
+  Tasks are not preempted, a long task should be split or resubmit itself.
+  Thread-safe.
+*/
+class TaskScheduler {
+public:
+    enum Priority {
+        PRIORITY_TRACKING = 0,      // the frontend stages, waited for by the caller
+        PRIORITY_BACKGROUND,        // the backend optimization
+        NUM_PRIORITIES
+    };
+
+    typedef std::function<void()> Task;
+    typedef std::function<void(const cv::Range&)> RangeTask;
+
+    // created at the first use with the scheduler parameters of the config
+    static TaskScheduler& getInstance() {
+        static TaskScheduler scheduler;
+        return scheduler;
+    }
+
+    ~TaskScheduler();
+
+    // run task on a worker without waiting
+    void submit(const Task& task, const Priority priority);
+
+    /*
+      Run func on sub-ranges of [begin, end) on the workers and on the calling
+      thread, return once all of them are done. May be nested in a task.
+      @param func  must be safe to call concurrently
+    */
+    void parallelFor(const int begin, const int end, const RangeTask& func,
+                     const Priority priority = PRIORITY_TRACKING);
+
+    int getNumWorkers() const { return workers_.size(); }
+
+private:
+    struct Worker {
+        mutex queueMutex;           // guards queues
+        std::deque<Task> queues[NUM_PRIORITIES];
+        thread workerThread;
+    };
+
+    struct ParallelForState;
+
+    vector<unique_ptr<Worker>> workers_;
+    atomic<int> queued_[NUM_PRIORITIES];    // tasks in all the queues
+    atomic<int> runningBackground_;
+    int maxBackground_;
+    atomic<unsigned> nextWorker_;   // round robin of the submissions from other threads
+
+    bool running_;                  // guarded by idleMutex_
+    mutex idleMutex_;
+    condition_variable taskAvailable_;
+
+    TaskScheduler();
+    TaskScheduler(const TaskScheduler&);
+    TaskScheduler& operator=(const TaskScheduler&);
+
+    void workerLoop(const int index);
+
+    // pop the next task for the worker, false if there is none it may run now
+    bool takeTask(const int index, Task& task, Priority& priority);
+
+    bool popTask(const int index, const Priority priority, Task& task);
+
+    bool hasRunnableTask() const;
+
+    // pin the calling thread to one core, false if not supported
+    static bool setAffinity(const int core);
+
+    static void runChunks(ParallelForState& state);
+
+}; // class TaskScheduler
+
+} // namespace
+
+#endif  // MYSLAM_TASK_SCHEDULER_H
@@ -2,7 +2,9 @@
 #define MYSLAM_UTIL_H
 
 // algorithms used in myslam
+#include <Eigen/Eigenvalues>
 #include "myslam/common_include.h"
+#include "myslam/task_scheduler.h"
 
 namespace myslam {
 
@@ -33,6 +35,44 @@ inline bool triangulation(const vector<SE3> &poses,
     return false;
 }
 
+/**
+ * accumulate one observation into the 4x4 normal equations of the linear triangulation
+ * @param m         [R|t] of the pose
+ * @param point     point in normalized plane
+ * @param AtA       A^T * A of the rows of all the observations so far
+ */
+inline void addTriangulationObservation(const Mat34 &m,
+                                        const Vec3 &point,
+                                        Eigen::Matrix4d &AtA) {
+    Eigen::Matrix<double, 1, 4> r0 = point[0] * m.row(2) - m.row(0);
+    Eigen::Matrix<double, 1, 4> r1 = point[1] * m.row(2) - m.row(1);
+    AtA.noalias() += r0.transpose() * r0;
+    AtA.noalias() += r1.transpose() * r1;
+}
+
+/**
+ * linear triangulation from the normal equations, same result and criterion as
+ * triangulation() without the dynamic size SVD: the eigenvalues of A^T * A
+ * are the squared singular values of A
+ * @param AtA       see addTriangulationObservation
+ * @param pt_world  triangulated point in the world
+ * @return true if success
+ */
+inline bool triangulationFromNormal(const Eigen::Matrix4d &AtA,
+                                    Vec3 &pt_world) {
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix4d> solver;
+    solver.computeDirect(AtA);
+    // eigenvalues in increasing order
+    const Eigen::Vector4d v = solver.eigenvectors().col(0);
+    if (std::abs(v[3]) < 1e-12) {
+        return false;
+    }
+    pt_world = (v / v[3]).head<3>();
+
+    const Eigen::Vector4d lambda = solver.eigenvalues();
+    return lambda[0] < 1e-4 * lambda[1];
+}
+
 inline Vector2d toVec2d(const cv::Point2f& pt) {
     return Vector2d ( pt.x, pt.y );
 }
@@ -67,6 +107,18 @@ struct KeyPointsComparision
 
 typedef unordered_set<cv::KeyPoint, KeyPointHash, KeyPointsComparision> KeyPointSet;
 
+/**
+ * run func on sub-ranges of [begin, end) in parallel on the shared task scheduler
+ * @param func  callable with a const cv::Range&, must be safe to call concurrently
+ */
+template<class Func>
+inline void parallelFor(int begin, int end, const Func& func) {
+    if (end <= begin) {
+        return;
+    }
+    TaskScheduler::getInstance().parallelFor(begin, end, TaskScheduler::RangeTask(func));
+}
+
 
 template<class T>
 struct WeakPtrHash
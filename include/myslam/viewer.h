@@ -9,6 +9,7 @@
 #include "myslam/frame.h"
 #include "myslam/util.h"
 #include "myslam/map.h"
+#include "myslam/config.h"
 #include <opencv2/features2d/features2d.hpp>
 
 namespace myslam {
@@ -19,7 +20,9 @@ public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
     typedef std::shared_ptr<Viewer> Ptr;
 
-    Viewer() {
+    // draws map, the map of the frontend of the same session
+    explicit Viewer(const Map::Ptr& map) : map_(map) {
+        update_interval_ = Config::get<int>("viewer_update_interval");
         viewer_running_ = true;
         viewer_thread_ = std::thread(std::bind(&Viewer::ThreadLoop, this));
     }
@@ -29,28 +32,36 @@ public:
         viewer_thread_.join();
     }
 
+    /*
+      Hand over the latest tracked frame, only the pointers are swapped.
+      The map itself is pulled by the viewer thread on its own schedule.
+    */
     void setCurrentFrame(const Frame::Ptr& current_frame, 
-                         const KeyPointSet& keypoints) {
+                         const shared_ptr<const KeyPointSet>& keypoints) {
         unique_lock<mutex> lck(viewer_data_mutex_);
         current_frame_ = current_frame;
         keypointsCurr_ = keypoints;
     }
 
-    /*
-      Update the all_keyframes_ and all_mappoints_
-    */
-    void updateDrawingObjects();
-
 private:
-    bool viewer_running_;
+    Map::Ptr map_;
+    atomic<bool> viewer_running_;
     thread viewer_thread_;
-    mutex viewer_data_mutex_;
+    mutex viewer_data_mutex_;       // guards current_frame_ and keypointsCurr_
+    int update_interval_;           // min time between two map snapshots in ms
+
+    // only used by the viewer thread
+    Map::KeyframeSnapshot all_keyframes_;
+    Map::MappointSnapshot all_mappoints_;
+    Map::MappointSnapshot active_mappoints_;
 
-    Map::KeyframeDict all_keyframes_;
-    Map::MappointDict all_mappoints_;
-    Map::MappointDict active_mappoints_;
     Frame::Ptr current_frame_;
-    KeyPointSet keypointsCurr_;
+    shared_ptr<const KeyPointSet> keypointsCurr_;
+
+    /*
+      Pull the snapshots of the keyframes and mappoints from the map
+    */
+    void updateDrawingObjects();
 
     void ThreadLoop();
 
@@ -58,12 +69,12 @@ private:
 
     void DrawMapPoints();
 
-    void DrawOtherKeyFrames();
+    void DrawOtherKeyFrames(const Frame::Ptr& current_frame);
 
-    void FollowCurrentFrame(pangolin::OpenGlRenderState& vis_camera);
+    void FollowCurrentFrame(const Frame::Ptr& current_frame, pangolin::OpenGlRenderState& vis_camera);
 
     /// plot the features in current frame into an image
-    cv::Mat PlotFrameImage();
+    cv::Mat PlotFrameImage(const Frame::Ptr& current_frame, const KeyPointSet& keypoints);
 
 }; // class Viewer
 
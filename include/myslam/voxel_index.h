@@ -0,0 +1,67 @@
+#ifndef MYSLAM_VOXEL_INDEX_H
+#define MYSLAM_VOXEL_INDEX_H
+
+#include "myslam/common_include.h"
+#include "myslam/frame.h"
+#include "myslam/mappoint.h"
+
+namespace myslam {
+
+/*
+  Voxel hash over the mappoints for visibility queries.
+  Each mappoint is stored in the voxel of the position it was inserted or
+  moved with, so a frustum query only visits the voxels around the camera.
+  Not thread safe, the map guards it with its data mutex.
+*/
+class VoxelIndex {
+public:
+    typedef std::shared_ptr<VoxelIndex> Ptr;
+
+    VoxelIndex(const double voxelSize, const double maxDepth);
+
+    void insert(const MapPoint::Ptr& mappoint, const Vector3d& pos);
+
+    // move a mappoint to the voxel of its new position
+    void update(const MapPoint::Ptr& mappoint, const Vector3d& pos);
+
+    void erase(const unsigned long id);
+
+    /*
+      Append the mappoints of all voxels intersecting the view frustum of frame,
+      up to maxDepth_. The points themselves are not checked with isInFrame.
+    */
+    void queryFrustum(const Frame::Ptr& frame, vector<MapPoint::Ptr>& mappoints) const;
+
+    size_t size() const { return pointVoxel_.size(); }
+
+private:
+    struct VoxelKey {
+        int x, y, z;
+        bool operator==(const VoxelKey& other) const {
+            return x == other.x && y == other.y && z == other.z;
+        }
+    };
+
+    struct VoxelKeyHash {
+        size_t operator()(const VoxelKey& key) const {
+            // the usual spatial hash primes
+            return size_t(key.x) * 73856093u ^ size_t(key.y) * 19349663u ^ size_t(key.z) * 83492791u;
+        }
+    };
+
+    typedef unordered_map<VoxelKey, vector<MapPoint::Ptr>, VoxelKeyHash> VoxelDict;
+
+    double voxelSize_;      // edge length of a voxel in meter
+    double maxDepth_;       // far plane of the frustum query
+    VoxelDict voxels_;
+    unordered_map<unsigned long, VoxelKey> pointVoxel_;  // voxel of each indexed mappoint
+
+    VoxelKey toKey(const Vector3d& pos) const;
+
+    void removeFromVoxel(const VoxelKey& key, const unsigned long id);
+
+}; // class VoxelIndex
+
+} // namespace
+
+#endif  // MYSLAM_VOXEL_INDEX_H
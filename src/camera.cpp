@@ -19,7 +19,6 @@
 
 #include "myslam/camera.h"
 #include "myslam/config.h"
-#include "myslam/util.h"
 
 namespace myslam
 {
@@ -31,53 +30,62 @@ Camera::Camera()
     cx_ = Config::get<float>("camera.cx");
     cy_ = Config::get<float>("camera.cy");
     depth_scale_ = Config::get<float>("camera.depth_scale");
+    k1_ = Config::get<float>("camera.k1");
+    k2_ = Config::get<float>("camera.k2");
+    p1_ = Config::get<float>("camera.p1");
+    p2_ = Config::get<float>("camera.p2");
 }
 
-Vector3d Camera::world2camera ( const Vector3d& p_w, const SE3& T_c_w )
+void Camera::projectBatch ( const SE3& T_c_w, const int width, const int height, ProjectionBatch& batch ) const
 {
-    return T_c_w*p_w;
-}
+    typedef Eigen::Array<float, Eigen::Dynamic, 1> ArrayXf;
+    typedef Eigen::Map<const ArrayXf> ConstArrayMap;
+    typedef Eigen::Map<ArrayXf> ArrayMap;
 
-Vector3d Camera::camera2world ( const Vector3d& p_c, const SE3& T_c_w )
-{
-    return T_c_w.inverse() *p_c;
-}
+    const int n = batch.size();
+    batch.u.resize(n);
+    batch.v.resize(n);
+    batch.depth.resize(n);
+    batch.cosAngle.resize(n);
+    batch.visible.resize(n);
+    if ( n == 0 ) {
+        return;
+    }
 
-Vector2d Camera::camera2pixel ( const Vector3d& p_c )
-{
-    return Vector2d (
-        fx_ * p_c ( 0,0 ) / p_c ( 2,0 ) + cx_,
-        fy_ * p_c ( 1,0 ) / p_c ( 2,0 ) + cy_
-    );
-}
+    const Eigen::Matrix3f R = T_c_w.rotationMatrix().cast<float>();
+    const Eigen::Vector3f t = T_c_w.translation().cast<float>();
+    const Eigen::Vector3f center = T_c_w.inverse().translation().cast<float>();
 
-Vector3d Camera::pixel2camera ( const Vector2d& p_p, double depth )
-{
-    return Vector3d (
-        ( p_p ( 0,0 )-cx_ ) *depth/fx_,
-        ( p_p ( 1,0 )-cy_ ) *depth/fy_,
-        depth
-    );
-}
+    ConstArrayMap x(batch.x.data(), n), y(batch.y.data(), n), z(batch.z.data(), n);
+    ConstArrayMap nx(batch.nx.data(), n), ny(batch.ny.data(), n), nz(batch.nz.data(), n);
 
-Vector3d Camera::pixel2camera ( const cv::Point2f& p_p, double depth )
-{
-    return pixel2camera(toVec2d(p_p), depth);
-}
+    // camera coordinates
+    ArrayMap depth(batch.depth.data(), n);
+    ArrayXf xc = R(0,0)*x + R(0,1)*y + R(0,2)*z + t[0];
+    ArrayXf yc = R(1,0)*x + R(1,1)*y + R(1,2)*z + t[1];
+    depth = R(2,0)*x + R(2,1)*y + R(2,2)*z + t[2];
 
-Vector2d Camera::world2pixel ( const Vector3d& p_w, const SE3& T_c_w )
-{
-    return camera2pixel ( world2camera ( p_w, T_c_w ) );
-}
+    // pixel coordinates
+    ArrayMap u(batch.u.data(), n), v(batch.v.data(), n);
+    ArrayXf zinv = depth.inverse();
+    if ( hasDistortion() ) {
+        ArrayXf xn = xc * zinv, yn = yc * zinv;
+        ArrayXf r2 = xn*xn + yn*yn;
+        ArrayXf radial = 1.0f + r2 * (k1_ + k2_ * r2);
+        u = fx_ * (xn*radial + 2.0f*p1_*xn*yn + p2_*(r2 + 2.0f*xn*xn)) + cx_;
+        v = fy_ * (yn*radial + p1_*(r2 + 2.0f*yn*yn) + 2.0f*p2_*xn*yn) + cy_;
+    } else {
+        u = fx_ * xc * zinv + cx_;
+        v = fy_ * yc * zinv + cy_;
+    }
 
-Vector3d Camera::pixel2world ( const Vector2d& p_p, const SE3& T_c_w, double depth )
-{
-    return camera2world ( pixel2camera ( p_p, depth ), T_c_w );
-}
+    // viewing angle, the direction from the camera center against the mean one
+    ArrayXf dx = x - center[0], dy = y - center[1], dz = z - center[2];
+    ArrayMap cosAngle(batch.cosAngle.data(), n);
+    cosAngle = (dx*nx + dy*ny + dz*nz) * (dx*dx + dy*dy + dz*dz).rsqrt();
 
-Vector3d Camera::pixel2world ( const cv::KeyPoint& p_p, const SE3& T_c_w, double depth )
-{
-    return pixel2world(toVec2d(p_p), T_c_w, depth);
+    Eigen::Map<Eigen::Array<uchar, Eigen::Dynamic, 1>> visible(batch.visible.data(), n);
+    visible = ( depth > 0 && u > 0 && v > 0 && u < float(width) && v < float(height) ).cast<uchar>();
 }
 
 }
@@ -0,0 +1,220 @@
+#include "myslam/covisibility_graph.h"
+
+namespace myslam {
+
+int CovisibilityGraph::keyFrameSlot(const unsigned long id)
+{
+    auto iter = keyFrameSlots_.find(id);
+    if (iter != keyFrameSlots_.end()) {
+        return iter->second;
+    }
+
+    int slot;
+    if (!freeKeyFrameSlots_.empty()) {
+        slot = freeKeyFrameSlots_.back();
+        freeKeyFrameSlots_.pop_back();
+    } else {
+        slot = keyFrames_.size();
+        keyFrames_.push_back(KeyFrameNode());
+    }
+    keyFrames_[slot].id = id;
+    keyFrames_[slot].mapPoints.clear();
+    keyFrames_[slot].neighbors.clear();
+    keyFrameSlots_[id] = slot;
+    return slot;
+}
+
+int CovisibilityGraph::mapPointSlot(const unsigned long id)
+{
+    auto iter = mapPointSlots_.find(id);
+    if (iter != mapPointSlots_.end()) {
+        return iter->second;
+    }
+
+    int slot;
+    if (!freeMapPointSlots_.empty()) {
+        slot = freeMapPointSlots_.back();
+        freeMapPointSlots_.pop_back();
+    } else {
+        slot = mapPoints_.size();
+        mapPoints_.push_back(MapPointNode());
+    }
+    mapPoints_[slot].id = id;
+    mapPoints_[slot].keyFrames.clear();
+    mapPointSlots_[id] = slot;
+    return slot;
+}
+
+void CovisibilityGraph::addNeighborWeight(KeyFrameNode& node, const int other, const int delta)
+{
+    for (size_t i = 0; i < node.neighbors.size(); i++) {
+        if (node.neighbors[i].first == other) {
+            node.neighbors[i].second += delta;
+            if (node.neighbors[i].second <= 0) {
+                node.neighbors[i] = node.neighbors.back();
+                node.neighbors.pop_back();
+            }
+            return;
+        }
+    }
+    if (delta > 0) {
+        node.neighbors.push_back(make_pair(other, delta));
+    }
+}
+
+void CovisibilityGraph::addWeight(const int kf1, const int kf2, const int delta)
+{
+    addNeighborWeight(keyFrames_[kf1], kf2, delta);
+    addNeighborWeight(keyFrames_[kf2], kf1, delta);
+}
+
+void CovisibilityGraph::addObservation(const unsigned long keyFrameId, const unsigned long mapPointId)
+{
+    unique_lock<mutex> lck(mutex_);
+    // allocate both slots before taking references into the node vectors
+    const int kf = keyFrameSlot(keyFrameId);
+    const int mp = mapPointSlot(mapPointId);
+
+    MapPointNode& mapPoint = mapPoints_[mp];
+    for (auto& link : mapPoint.keyFrames) {
+        if (link.slot == kf) {
+            return;
+        }
+    }
+
+    // every keyframe already observing the mappoint shares one more with this one
+    for (auto& link : mapPoint.keyFrames) {
+        addWeight(kf, link.slot, 1);
+    }
+
+    KeyFrameNode& keyFrame = keyFrames_[kf];
+    Link toMapPoint = {mp, int(mapPoint.keyFrames.size())};
+    Link toKeyFrame = {kf, int(keyFrame.mapPoints.size())};
+    keyFrame.mapPoints.push_back(toMapPoint);
+    mapPoint.keyFrames.push_back(toKeyFrame);
+}
+
+bool CovisibilityGraph::removeObservationAt(const int kf, const int i)
+{
+    KeyFrameNode& keyFrame = keyFrames_[kf];
+    const Link obs = keyFrame.mapPoints[i];
+    const int mp = obs.slot;
+    MapPointNode& mapPoint = mapPoints_[mp];
+
+    // swap the last observation of the mappoint into the removed one
+    if (obs.pos != int(mapPoint.keyFrames.size()) - 1) {
+        const Link moved = mapPoint.keyFrames.back();
+        mapPoint.keyFrames[obs.pos] = moved;
+        keyFrames_[moved.slot].mapPoints[moved.pos].pos = obs.pos;
+    }
+    mapPoint.keyFrames.pop_back();
+
+    for (auto& link : mapPoint.keyFrames) {
+        addWeight(kf, link.slot, -1);
+    }
+
+    // same on the keyframe side
+    if (i != int(keyFrame.mapPoints.size()) - 1) {
+        const Link moved = keyFrame.mapPoints.back();
+        keyFrame.mapPoints[i] = moved;
+        mapPoints_[moved.slot].keyFrames[moved.pos].pos = i;
+    }
+    keyFrame.mapPoints.pop_back();
+
+    if (mapPoint.keyFrames.empty()) {
+        mapPointSlots_.erase(mapPoint.id);
+        freeMapPointSlots_.push_back(mp);
+        return true;
+    }
+    return false;
+}
+
+void CovisibilityGraph::removeObservation(const unsigned long keyFrameId, const unsigned long mapPointId)
+{
+    unique_lock<mutex> lck(mutex_);
+    auto kfIter = keyFrameSlots_.find(keyFrameId);
+    auto mpIter = mapPointSlots_.find(mapPointId);
+    if (kfIter == keyFrameSlots_.end() || mpIter == mapPointSlots_.end()) {
+        return;
+    }
+
+    for (auto& link : mapPoints_[mpIter->second].keyFrames) {
+        if (link.slot == kfIter->second) {
+            removeObservationAt(kfIter->second, link.pos);
+            return;
+        }
+    }
+}
+
+void CovisibilityGraph::removeKeyFrame(const unsigned long keyFrameId)
+{
+    unique_lock<mutex> lck(mutex_);
+    auto iter = keyFrameSlots_.find(keyFrameId);
+    if (iter == keyFrameSlots_.end()) {
+        return;
+    }
+
+    const int kf = iter->second;
+    while (!keyFrames_[kf].mapPoints.empty()) {
+        removeObservationAt(kf, keyFrames_[kf].mapPoints.size() - 1);
+    }
+    keyFrames_[kf].neighbors.clear();
+    keyFrameSlots_.erase(iter);
+    freeKeyFrameSlots_.push_back(kf);
+}
+
+CovisibilityGraph::ConnectedKeyFrames CovisibilityGraph::getConnectedKeyFrames(const unsigned long keyFrameId)
+{
+    unique_lock<mutex> lck(mutex_);
+    ConnectedKeyFrames connected;
+    auto iter = keyFrameSlots_.find(keyFrameId);
+    if (iter == keyFrameSlots_.end()) {
+        return connected;
+    }
+
+    int maxWeight = 0, maxWeightSlot = -1;
+    for (auto& neighbor : keyFrames_[iter->second].neighbors) {
+        if (neighbor.second >= minWeight_) {
+            connected[keyFrames_[neighbor.first].id] = neighbor.second;
+        }
+        if (neighbor.second > maxWeight) {
+            maxWeight = neighbor.second;
+            maxWeightSlot = neighbor.first;
+        }
+    }
+
+    // In case there is no weight larger than minWeight_
+    if (connected.empty() && maxWeightSlot >= 0) {
+        connected[keyFrames_[maxWeightSlot].id] = maxWeight;
+    }
+    return connected;
+}
+
+int CovisibilityGraph::getWeight(const unsigned long keyFrameId1, const unsigned long keyFrameId2)
+{
+    unique_lock<mutex> lck(mutex_);
+    auto iter1 = keyFrameSlots_.find(keyFrameId1);
+    auto iter2 = keyFrameSlots_.find(keyFrameId2);
+    if (iter1 == keyFrameSlots_.end() || iter2 == keyFrameSlots_.end()) {
+        return 0;
+    }
+    for (auto& neighbor : keyFrames_[iter1->second].neighbors) {
+        if (neighbor.first == iter2->second) {
+            return neighbor.second;
+        }
+    }
+    return 0;
+}
+
+void CovisibilityGraph::clear()
+{
+    unique_lock<mutex> lck(mutex_);
+    keyFrames_.clear();
+    mapPoints_.clear();
+    freeKeyFrameSlots_.clear();
+    freeMapPointSlots_.clear();
+    keyFrameSlots_.clear();
+    mapPointSlots_.clear();
+}
+
+} // namespace
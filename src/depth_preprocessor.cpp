@@ -0,0 +1,84 @@
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "myslam/depth_preprocessor.h"
+#include "myslam/config.h"
+
+namespace myslam {
+
+BackProjectionTable::BackProjectionTable(const Camera& camera, const int width, const int height)
+: rayX(width), rayY(height), invFx(1.0f / camera.fx_), invFy(1.0f / camera.fy_)
+{
+    for (int x = 0; x < width; x++) {
+        rayX[x] = (x - camera.cx_) * invFx;
+    }
+    for (int y = 0; y < height; y++) {
+        rayY[y] = (y - camera.cy_) * invFy;
+    }
+}
+
+DepthPreprocessor::DepthPreprocessor(const Camera::Ptr& camera)
+: camera_(camera)
+{
+    fillHoles_ = Config::get<int>("depth_fill_holes");
+    bilateralFilter_ = Config::get<int>("depth_bilateral_filter");
+    bilateralDiameter_ = Config::get<int>("depth_bilateral_diameter");
+    bilateralSigmaDepth_ = Config::get<double>("depth_bilateral_sigma_depth");
+    bilateralSigmaSpace_ = Config::get<double>("depth_bilateral_sigma_space");
+}
+
+void DepthPreprocessor::process(const Mat& raw, Mat& depth) const
+{
+    // vectorized conversion, the raw 0 of the invalid pixels stays 0
+    raw.convertTo(depth, CV_32F, 1.0 / camera_->depth_scale_);
+
+    if (fillHoles_) {
+        // a hole takes the first valid of its 4 neighbours in the original depth,
+        // the same fallback findDepth used to do per keypoint, with bounds checks
+        const Mat original = depth.clone();
+        const int dx[4] = {-1, 0, 1, 0};
+        const int dy[4] = {0, -1, 0, 1};
+        for (int y = 0; y < depth.rows; y++) {
+            float* row = depth.ptr<float>(y);
+            for (int x = 0; x < depth.cols; x++) {
+                if (row[x] > 0) {
+                    continue;
+                }
+                for (int i = 0; i < 4; i++) {
+                    const int nx = x + dx[i], ny = y + dy[i];
+                    if (nx < 0 || ny < 0 || nx >= depth.cols || ny >= depth.rows) {
+                        continue;
+                    }
+                    const float d = original.ptr<float>(ny)[nx];
+                    if (d > 0) {
+                        row[x] = d;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    if (bilateralFilter_) {
+        // the holes are far from any depth in the range kernel, they barely
+        // leak into the valid pixels, and stay invalid afterwards
+        const Mat valid = depth > 0;
+        Mat filtered;
+        cv::bilateralFilter(depth, filtered, bilateralDiameter_, bilateralSigmaDepth_, bilateralSigmaSpace_);
+        depth = Mat::zeros(depth.size(), CV_32F);
+        filtered.copyTo(depth, valid);
+    }
+}
+
+BackProjectionTable::ConstPtr DepthPreprocessor::getBackProjectionTable(const int width, const int height)
+{
+    if (camera_->hasDistortion()) {
+        return nullptr;
+    }
+    unique_lock<mutex> lck(tableMutex_);
+    if (table_ == nullptr || int(table_->rayX.size()) != width || int(table_->rayY.size()) != height) {
+        table_ = BackProjectionTable::ConstPtr(new BackProjectionTable(*camera_, width, height));
+    }
+    return table_;
+}
+
+} // namespace
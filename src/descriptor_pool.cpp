@@ -0,0 +1,76 @@
+#include <cstdlib>
+#include <cstring>
+
+#include "myslam/descriptor_pool.h"
+
+namespace myslam {
+
+DescriptorPool::DescriptorPool(const size_t blockSize)
+: blockSize_(max<size_t>(1, blockSize)), nextSlotInBlock_(0), usedSlots_(0)
+{
+}
+
+DescriptorPool::~DescriptorPool()
+{
+    for (auto block : blocks_) {
+        free(block);
+    }
+}
+
+const uchar* DescriptorPool::allocate(const uchar* descriptor)
+{
+    unique_lock<mutex> lck(poolMutex_);
+
+    uchar* slot = nullptr;
+    if (!freeSlots_.empty()) {
+        slot = freeSlots_.back();
+        freeSlots_.pop_back();
+    } else {
+        if (blocks_.empty() || nextSlotInBlock_ == blockSize_) {
+            void* block = nullptr;
+            if (posix_memalign(&block, 32, blockSize_ * DESCRIPTOR_SIZE) != 0) {
+                throw std::bad_alloc();
+            }
+            blocks_.push_back(static_cast<uchar*>(block));
+            nextSlotInBlock_ = 0;
+        }
+        slot = blocks_.back() + nextSlotInBlock_ * DESCRIPTOR_SIZE;
+        nextSlotInBlock_++;
+    }
+
+    memcpy(slot, descriptor, DESCRIPTOR_SIZE);
+    usedSlots_++;
+    return slot;
+}
+
+void DescriptorPool::release(const uchar* descriptor)
+{
+    if (descriptor == nullptr) {
+        return;
+    }
+    unique_lock<mutex> lck(poolMutex_);
+    if (!isAttached(descriptor)) {
+        freeSlots_.push_back(const_cast<uchar*>(descriptor));
+    }
+    usedSlots_--;
+}
+
+void DescriptorPool::attach(const uchar* descriptors, const size_t count, const shared_ptr<const void>& owner)
+{
+    unique_lock<mutex> lck(poolMutex_);
+    attached_.push_back(make_pair(descriptors, descriptors + count * DESCRIPTOR_SIZE));
+    attachedOwners_.push_back(owner);
+    usedSlots_ += count;
+}
+
+bool DescriptorPool::isAttached(const uchar* descriptor) const
+{
+    for (auto& range : attached_) {
+        if (descriptor >= range.first && descriptor < range.second) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
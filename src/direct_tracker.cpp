@@ -0,0 +1,319 @@
+#include <opencv2/imgproc/imgproc.hpp>
+#include <Eigen/Cholesky>
+
+#include "myslam/direct_tracker.h"
+#include "myslam/config.h"
+#include "myslam/util.h"
+
+namespace myslam {
+
+typedef Eigen::Matrix<double, 6, 6> Matrix6d;
+typedef Eigen::Matrix<double, 6, 1> Vector6d;
+typedef Eigen::Matrix<float, 6, 1> Vector6f;
+
+namespace {
+
+// points per chunk of the parallel reduction, the chunks are summed in order
+// so the result does not depend on the scheduling
+const int CHUNK_SIZE = 256;
+
+// min residuals to solve a level
+const int MIN_RESIDUALS = 10;
+
+// bilinear interpolation, needs 0 <= u < cols - 1 and 0 <= v < rows - 1
+inline float interpolate(const Mat& img, const int x0, const int y0, const float ax, const float ay)
+{
+    const float* r0 = img.ptr<float>(y0) + x0;
+    const float* r1 = img.ptr<float>(y0 + 1) + x0;
+    return (1 - ay) * ((1 - ax) * r0[0] + ax * r0[1]) + ay * ((1 - ax) * r1[0] + ax * r1[1]);
+}
+
+// weight of the Huber kernel, adds the robust cost of r
+inline float huberWeight(const float r, const float delta, float& cost)
+{
+    const float a = fabs(r);
+    if (a <= delta) {
+        cost += r * r;
+        return 1.0f;
+    }
+    cost += 2 * delta * a - delta * delta;
+    return delta / a;
+}
+
+} // namespace
+
+DirectTracker::DirectTracker()
+: validRatio_(0)
+{
+    levels_ = max(1, Config::get<int>("direct_pyramid_levels"));
+    iterations_ = Config::get<int>("direct_iterations");
+    maxPoints_ = max(MIN_RESIDUALS, Config::get<int>("direct_max_points"));
+    minGradient_ = Config::get<float>("direct_min_gradient");
+    minDepth_ = Config::get<float>("direct_min_depth");
+    maxDepth_ = Config::get<float>("direct_max_depth");
+    huberPhotometric_ = Config::get<float>("direct_huber_photometric");
+    geometricWeight_ = Config::get<float>("direct_geometric_weight");
+    huberGeometric_ = Config::get<float>("direct_huber_geometric");
+    minValidRatio_ = Config::get<float>("direct_min_valid_ratio");
+}
+
+void DirectTracker::buildPyramid(const Frame::Ptr& frame, vector<Level>& pyramid) const
+{
+    pyramid.resize(levels_);
+
+    Mat gray = frame->color_;
+    if (gray.channels() == 3) {
+        cv::cvtColor(frame->color_, gray, cv::COLOR_BGR2GRAY);
+    }
+    gray.convertTo(pyramid[0].gray, CV_32F);
+
+    // frames which did not go through the DepthPreprocessor
+    pyramid[0].depth = frame->depthMeters_;
+    if (pyramid[0].depth.empty()) {
+        frame->depth_.convertTo(pyramid[0].depth, CV_32F, 1.0 / frame->camera_->depth_scale_);
+    }
+
+    const Camera::Ptr& camera = frame->camera_;
+    pyramid[0].fx = camera->fx_;
+    pyramid[0].fy = camera->fy_;
+    pyramid[0].cx = camera->cx_;
+    pyramid[0].cy = camera->cy_;
+
+    for (int l = 1; l < levels_; l++) {
+        const Level& prev = pyramid[l - 1];
+        Level& level = pyramid[l];
+        cv::pyrDown(prev.gray, level.gray);
+        // nearest neighbour, averaging would mix the invalid depths into the valid ones
+        cv::resize(prev.depth, level.depth, level.gray.size(), 0, 0, cv::INTER_NEAREST);
+        level.fx = prev.fx * 0.5f;
+        level.fy = prev.fy * 0.5f;
+        level.cx = (prev.cx + 0.5f) * 0.5f - 0.5f;
+        level.cy = (prev.cy + 0.5f) * 0.5f - 0.5f;
+    }
+
+    for (auto& level : pyramid) {
+        // derivatives per pixel
+        cv::Sobel(level.gray, level.gradX, CV_32F, 1, 0, 3, 1.0 / 8);
+        cv::Sobel(level.gray, level.gradY, CV_32F, 0, 1, 3, 1.0 / 8);
+
+        if (geometricWeight_ <= 0) {
+            continue;
+        }
+        // central differences only where both sides are valid, the depth
+        // discontinuities at the holes would give arbitrary gradients
+        const Mat& depth = level.depth;
+        level.depthInner = Mat::zeros(depth.size(), CV_32F);
+        level.depthGradX = Mat::zeros(depth.size(), CV_32F);
+        level.depthGradY = Mat::zeros(depth.size(), CV_32F);
+        for (int y = 1; y < depth.rows - 1; y++) {
+            const float* up = depth.ptr<float>(y - 1);
+            const float* row = depth.ptr<float>(y);
+            const float* down = depth.ptr<float>(y + 1);
+            float* inner = level.depthInner.ptr<float>(y);
+            float* gx = level.depthGradX.ptr<float>(y);
+            float* gy = level.depthGradY.ptr<float>(y);
+            for (int x = 1; x < depth.cols - 1; x++) {
+                if (row[x] > 0 && row[x - 1] > 0 && row[x + 1] > 0 && up[x] > 0 && down[x] > 0) {
+                    inner[x] = row[x];
+                    gx[x] = 0.5f * (row[x + 1] - row[x - 1]);
+                    gy[x] = 0.5f * (down[x] - up[x]);
+                }
+            }
+        }
+    }
+}
+
+void DirectTracker::setReference(const Frame::Ptr& keyFrame)
+{
+    vector<Level> pyramid;
+    if (keyFrame == lastFrame_) {
+        pyramid.swap(lastPyramid_);
+    } else {
+        buildPyramid(keyFrame, pyramid);
+    }
+    lastFrame_ = nullptr;
+    lastPyramid_.clear();
+
+    reference_ = keyFrame;
+    referencePoints_.resize(levels_);
+    const float minGradient2 = minGradient_ * minGradient_;
+    vector<int> candidates;
+    for (int l = 0; l < levels_; l++) {
+        const Level& level = pyramid[l];
+        Points& points = referencePoints_[l];
+        points.clear();
+
+        // pixels with a valid depth and enough gradient to constrain the pose
+        candidates.clear();
+        for (int y = 1; y < level.gray.rows - 1; y++) {
+            const float* depth = level.depth.ptr<float>(y);
+            const float* gx = level.gradX.ptr<float>(y);
+            const float* gy = level.gradY.ptr<float>(y);
+            for (int x = 1; x < level.gray.cols - 1; x++) {
+                if (depth[x] >= minDepth_ && depth[x] <= maxDepth_ && gx[x] * gx[x] + gy[x] * gy[x] >= minGradient2) {
+                    candidates.push_back(y * level.gray.cols + x);
+                }
+            }
+        }
+
+        // uniform subsampling above the max number of pixels
+        const size_t step = (candidates.size() + maxPoints_ - 1) / maxPoints_;
+        for (size_t i = 0; i < candidates.size(); i += max<size_t>(step, 1)) {
+            const int x = candidates[i] % level.gray.cols;
+            const int y = candidates[i] / level.gray.cols;
+            const float d = level.depth.ptr<float>(y)[x];
+            points.x.push_back((x - level.cx) / level.fx * d);
+            points.y.push_back((y - level.cy) / level.fy * d);
+            points.z.push_back(d);
+            points.intensity.push_back(level.gray.ptr<float>(y)[x]);
+        }
+    }
+    cout << "  Direct tracking reference " << keyFrame->getId() << ": " << referencePoints_[0].size() << " pixels" << endl;
+}
+
+int DirectTracker::accumulate(const Level& level, const Points& points, const SE3& T_c_r,
+                              Matrix6d& H, Vector6d& b, double& cost)
+{
+    const int n = points.size();
+    const int chunks = (n + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    accumulators_.resize(chunks);
+
+    const Eigen::Matrix3f R = T_c_r.rotationMatrix().cast<float>();
+    const Eigen::Vector3f t = T_c_r.translation().cast<float>();
+    const float fx = level.fx, fy = level.fy, cx = level.cx, cy = level.cy;
+    const float maxU = level.gray.cols - 1, maxV = level.gray.rows - 1;
+    const bool geometric = geometricWeight_ > 0;
+    const float huberGeometric = geometricWeight_ * huberGeometric_;
+
+    parallelFor(0, chunks, [&](const cv::Range& range) {
+        Vector6f Ju, Jv, J, Jz;
+        for (int c = range.start; c < range.end; c++) {
+            Accumulator& acc = accumulators_[c];
+            acc.H.setZero();
+            acc.b.setZero();
+            acc.cost = 0;
+            acc.count = 0;
+
+            const int end = min(n, (c + 1) * CHUNK_SIZE);
+            for (int i = c * CHUNK_SIZE; i < end; i++) {
+                const Eigen::Vector3f p = R * Eigen::Vector3f(points.x[i], points.y[i], points.z[i]) + t;
+                if (p[2] <= 0) {
+                    continue;
+                }
+                const float X = p[0], Y = p[1];
+                const float zInv = 1.0f / p[2];
+                const float zInv2 = zInv * zInv;
+                const float u = fx * X * zInv + cx;
+                const float v = fy * Y * zInv + cy;
+                if (!(u >= 0 && v >= 0 && u < maxU && v < maxV)) {
+                    continue;
+                }
+                const int x0 = int(u), y0 = int(v);
+                const float ax = u - x0, ay = v - y0;
+
+                // jacobian of the projection, projectPoseJacobian in camera_model.h with the pinhole model
+                Ju << fx * zInv, 0, -fx * X * zInv2, -fx * X * Y * zInv2, fx + fx * X * X * zInv2, -fx * Y * zInv;
+                Jv << 0, fy * zInv, -fy * Y * zInv2, -fy - fy * Y * Y * zInv2, fy * X * Y * zInv2, fy * X * zInv;
+
+                // photometric residual
+                const float r = interpolate(level.gray, x0, y0, ax, ay) - points.intensity[i];
+                J = interpolate(level.gradX, x0, y0, ax, ay) * Ju + interpolate(level.gradY, x0, y0, ax, ay) * Jv;
+                float w = huberWeight(r, huberPhotometric_, acc.cost);
+                acc.H.selfadjointView<Eigen::Upper>().rankUpdate(J, w);
+                acc.b.noalias() -= (w * r) * J;
+                acc.count++;
+
+                if (!geometric) {
+                    continue;
+                }
+                // geometric residual, the depth image against the depth of the warped point
+                const float* inner0 = level.depthInner.ptr<float>(y0) + x0;
+                const float* inner1 = level.depthInner.ptr<float>(y0 + 1) + x0;
+                if (!(inner0[0] > 0 && inner0[1] > 0 && inner1[0] > 0 && inner1[1] > 0)) {
+                    continue;
+                }
+                const float rz = geometricWeight_ * (interpolate(level.depthInner, x0, y0, ax, ay) - p[2]);
+                Jz << 0, 0, 1, Y, -X, 0;
+                J = geometricWeight_ * (interpolate(level.depthGradX, x0, y0, ax, ay) * Ju
+                                        + interpolate(level.depthGradY, x0, y0, ax, ay) * Jv - Jz);
+                w = huberWeight(rz, huberGeometric, acc.cost);
+                acc.H.selfadjointView<Eigen::Upper>().rankUpdate(J, w);
+                acc.b.noalias() -= (w * rz) * J;
+            }
+        }
+    });
+
+    // float within a chunk, double across the chunks
+    Matrix6d upper = Matrix6d::Zero();
+    b.setZero();
+    cost = 0;
+    int count = 0;
+    for (auto& acc : accumulators_) {
+        upper += acc.H.cast<double>();
+        b += acc.b.cast<double>();
+        cost += acc.cost;
+        count += acc.count;
+    }
+    H = upper.selfadjointView<Eigen::Upper>();
+    return count;
+}
+
+bool DirectTracker::track(const Frame::Ptr& frame, SE3& pose)
+{
+    validRatio_ = 0;
+    if (reference_ == nullptr) {
+        return false;
+    }
+
+    vector<Level> pyramid;
+    pyramid.swap(lastPyramid_);
+    buildPyramid(frame, pyramid);
+
+    // the keyframe pose may have been refined by the backend since it became the reference
+    const SE3 T_r_w = reference_->getPose();
+    SE3 T_c_r = pose * T_r_w.inverse();
+
+    Matrix6d H, newH;
+    Vector6d b, newB;
+    double cost, newCost;
+    int count = 0;
+    for (int l = levels_ - 1; l >= 0; l--) {
+        const Points& points = referencePoints_[l];
+        count = accumulate(pyramid[l], points, T_c_r, H, b, cost);
+        for (int iter = 0; iter < iterations_ && count >= MIN_RESIDUALS; iter++) {
+            Vector6d delta = H.ldlt().solve(b);
+            if (!delta.allFinite()) {
+                break;
+            }
+
+            // Gauss-Newton step, kept only if the mean cost decreases
+            SE3 newT_c_r = SE3::exp(delta) * T_c_r;
+            int newCount = accumulate(pyramid[l], points, newT_c_r, newH, newB, newCost);
+            if (newCount < MIN_RESIDUALS || newCost / newCount >= cost / count) {
+                break;
+            }
+            T_c_r = newT_c_r;
+            H = newH;
+            b = newB;
+            cost = newCost;
+            count = newCount;
+            if (delta.norm() < 1e-6) {
+                break;
+            }
+        }
+    }
+
+    lastFrame_ = frame;
+    lastPyramid_.swap(pyramid);
+
+    validRatio_ = referencePoints_[0].size() > 0 ? float(count) / referencePoints_[0].size() : 0;
+    cout << "  Direct tracking pixels in view: " << count << " of " << referencePoints_[0].size() << endl;
+    if (count < MIN_RESIDUALS || validRatio_ < minValidRatio_) {
+        return false;
+    }
+
+    pose = T_c_r * T_r_w;
+    return true;
+}
+
+} // namespace
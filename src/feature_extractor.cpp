@@ -0,0 +1,362 @@
+#include <chrono>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "myslam/feature_extractor.h"
+#include "myslam/config.h"
+#include "myslam/util.h"
+#include "myslam/profiler.h"
+
+namespace myslam {
+
+const int PATCH_SIZE = 31;
+const int HALF_PATCH_SIZE = 15;
+const int EDGE_THRESHOLD = 19;
+
+// intensity centroid orientation of a keypoint in degree
+static float computeICAngle(const Mat& image, const cv::Point2f& pt, const vector<int>& umax)
+{
+    int m_01 = 0, m_10 = 0;
+    const uchar* center = &image.at<uchar>(cvRound(pt.y), cvRound(pt.x));
+
+    // the center line
+    for (int u = -HALF_PATCH_SIZE; u <= HALF_PATCH_SIZE; ++u) {
+        m_10 += u * center[u];
+    }
+
+    // the symmetric lines above and below the center
+    int step = (int)image.step;
+    for (int v = 1; v <= HALF_PATCH_SIZE; ++v) {
+        int v_sum = 0;
+        int d = umax[v];
+        for (int u = -d; u <= d; ++u) {
+            int val_plus = center[u + v * step], val_minus = center[u - v * step];
+            v_sum += (val_plus - val_minus);
+            m_10 += u * (val_plus + val_minus);
+        }
+        m_01 += v * v_sum;
+    }
+
+    return cv::fastAtan2((float)m_01, (float)m_10);
+}
+
+FeatureExtractor::FeatureExtractor() : extractorRunning_(false)
+{
+    numFeatures_ = Config::get<int>("number_of_features");
+    scaleFactor_ = Config::get<double>("scale_factor");
+    numLevels_ = Config::get<int>("level_pyramid");
+    orb_ = cv::ORB::create(numFeatures_, scaleFactor_, numLevels_);
+    pipelineDepth_ = max(1, Config::get<int>("pipeline_depth"));
+
+    gridExtraction_ = Config::get<int>("grid_extraction");
+    cellSize_ = max(10, Config::get<int>("grid_cell_size"));
+    iniThFAST_ = Config::get<int>("fast_threshold_init");
+    minThFAST_ = Config::get<int>("fast_threshold_min");
+
+    maxLevels_ = numLevels_;
+    pendingFeatures_ = numFeatures_;
+    pendingLevels_ = numLevels_;
+    lastExtractionMs_ = 0;
+    computeLevelBudgets();
+
+    // row bounds of the circular patch
+    umax_.resize(HALF_PATCH_SIZE + 1);
+    int v, v0, vmax = cvFloor(HALF_PATCH_SIZE * sqrt(2.f) / 2 + 1);
+    int vmin = cvCeil(HALF_PATCH_SIZE * sqrt(2.f) / 2);
+    const double hp2 = HALF_PATCH_SIZE * HALF_PATCH_SIZE;
+    for (v = 0; v <= vmax; ++v) {
+        umax_[v] = cvRound(sqrt(hp2 - v * v));
+    }
+    // make sure the patch is symmetric
+    for (v = HALF_PATCH_SIZE, v0 = 0; v >= vmin; --v) {
+        while (umax_[v0] == umax_[v0 + 1]) {
+            ++v0;
+        }
+        umax_[v] = v0;
+        ++v0;
+    }
+
+    // the descriptor of each level is computed on the level image directly
+    for (int level = 0; level < maxLevels_; level++) {
+        levelOrbs_.push_back(cv::ORB::create(numFeatures_, scaleFactor_, 1, EDGE_THRESHOLD,
+                                             0, 2, cv::ORB::HARRIS_SCORE, PATCH_SIZE, iniThFAST_));
+    }
+}
+
+void FeatureExtractor::computeLevelBudgets()
+{
+    // the number of features of each level decreases with the image area
+    featuresPerLevel_.resize(numLevels_);
+    double factor = 1.0 / scaleFactor_;
+    double desiredFeatures = numFeatures_ * (1 - factor) / (1 - pow(factor, numLevels_));
+    int sumFeatures = 0;
+    for (int level = 0; level < numLevels_ - 1; level++) {
+        featuresPerLevel_[level] = cvRound(desiredFeatures);
+        sumFeatures += featuresPerLevel_[level];
+        desiredFeatures *= factor;
+    }
+    featuresPerLevel_[numLevels_ - 1] = max(numFeatures_ - sumFeatures, 0);
+}
+
+void FeatureExtractor::setBudget(const int numFeatures, const int numLevels)
+{
+    unique_lock<mutex> lock(budgetMutex_);
+    pendingFeatures_ = max(1, numFeatures);
+    pendingLevels_ = min(maxLevels_, max(1, numLevels));
+}
+
+void FeatureExtractor::applyBudget()
+{
+    unique_lock<mutex> lock(budgetMutex_);
+    if (pendingFeatures_ == numFeatures_ && pendingLevels_ == numLevels_) {
+        return;
+    }
+    numFeatures_ = pendingFeatures_;
+    numLevels_ = pendingLevels_;
+    computeLevelBudgets();
+    orb_->setMaxFeatures(numFeatures_);
+    orb_->setNLevels(numLevels_);
+}
+
+void FeatureExtractor::extract(const Frame::Ptr& frame)
+{
+    // may run ahead of the frontend on the pipeline thread, so record with the frame id
+    ScopedTimer timer(Profiler::STAGE_EXTRACT, frame->getId());
+    const auto start = std::chrono::steady_clock::now();
+    applyBudget();
+    if (gridExtraction_) {
+        extractGrid(frame);
+    } else {
+        orb_->detectAndCompute(frame->color_, Mat(), frame->keypoints_, frame->descriptors_);
+    }
+    frame->featuresExtracted_ = true;
+    lastExtractionMs_ = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void FeatureExtractor::extractGrid(const Frame::Ptr& frame)
+{
+    Mat gray = frame->color_;
+    if (gray.channels() == 3) {
+        cv::cvtColor(frame->color_, gray, cv::COLOR_BGR2GRAY);
+    }
+
+    // build the image pyramid
+    vector<Mat> pyramid(numLevels_);
+    vector<double> scales(numLevels_, 1.0);
+    pyramid[0] = gray;
+    for (int level = 1; level < numLevels_; level++) {
+        scales[level] = scales[level - 1] * scaleFactor_;
+        cv::Size sz(cvRound(gray.cols / scales[level]), cvRound(gray.rows / scales[level]));
+        cv::resize(pyramid[level - 1], pyramid[level], sz, 0, 0, cv::INTER_LINEAR);
+    }
+
+    // tile the valid area of every level into cells
+    struct Cell {
+        int level;
+        cv::Rect rect;      // area owned by the cell
+        cv::Rect patch;     // area searched by FAST, 3 pixels larger for the FAST circle
+    };
+    vector<Cell> cells;
+    vector<int> cellsBegin(numLevels_ + 1, 0);
+    for (int level = 0; level < numLevels_; level++) {
+        cellsBegin[level] = cells.size();
+        const Mat& image = pyramid[level];
+        const int minX = EDGE_THRESHOLD, minY = EDGE_THRESHOLD;
+        const int maxX = image.cols - EDGE_THRESHOLD, maxY = image.rows - EDGE_THRESHOLD;
+        const int width = maxX - minX, height = maxY - minY;
+        if (width <= 0 || height <= 0) {
+            continue;
+        }
+
+        const int cols = max(1, width / cellSize_), rows = max(1, height / cellSize_);
+        const int cellW = cvCeil(double(width) / cols), cellH = cvCeil(double(height) / rows);
+        for (int r = 0; r < rows; r++) {
+            for (int c = 0; c < cols; c++) {
+                int x0 = minX + c * cellW, y0 = minY + r * cellH;
+                int x1 = min(x0 + cellW, maxX), y1 = min(y0 + cellH, maxY);
+                if (x1 <= x0 || y1 <= y0) {
+                    continue;
+                }
+                Cell cell;
+                cell.level = level;
+                cell.rect = cv::Rect(x0, y0, x1 - x0, y1 - y0);
+                cell.patch = cv::Rect(x0 - 3, y0 - 3, x1 - x0 + 6, y1 - y0 + 6);
+                cells.push_back(cell);
+            }
+        }
+    }
+    cellsBegin[numLevels_] = cells.size();
+
+    // FAST in every cell, fall back to the lower threshold for low texture cells
+    vector<vector<cv::KeyPoint>> cellKeyPoints(cells.size());
+    parallelFor(0, cells.size(), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; i++) {
+            const Cell& cell = cells[i];
+            Mat patch = pyramid[cell.level](cell.patch);
+            vector<cv::KeyPoint> kps;
+            cv::FAST(patch, kps, iniThFAST_, true);
+            if (kps.empty()) {
+                cv::FAST(patch, kps, minThFAST_, true);
+            }
+
+            // only keep the keypoints owned by this cell
+            for (auto& kp : kps) {
+                kp.pt.x += cell.patch.x;
+                kp.pt.y += cell.patch.y;
+                if (kp.pt.x >= cell.rect.x && kp.pt.x < cell.rect.x + cell.rect.width
+                    && kp.pt.y >= cell.rect.y && kp.pt.y < cell.rect.y + cell.rect.height)
+                {
+                    cellKeyPoints[i].push_back(kp);
+                }
+            }
+        }
+    });
+
+    // uniform distribution, orientation and descriptors of every level in parallel
+    vector<vector<cv::KeyPoint>> levelKeyPoints(numLevels_);
+    vector<Mat> levelDescriptors(numLevels_);
+    parallelFor(0, numLevels_, [&](const cv::Range& range) {
+        for (int level = range.start; level < range.end; level++) {
+            vector<vector<cv::KeyPoint>> levelCells(
+                cellKeyPoints.begin() + cellsBegin[level],
+                cellKeyPoints.begin() + cellsBegin[level + 1]);
+
+            vector<cv::KeyPoint> kps;
+            distributeKeyPoints(levelCells, featuresPerLevel_[level], kps);
+
+            // keep the patch inside the image
+            const Mat& image = pyramid[level];
+            vector<cv::KeyPoint> valid;
+            for (auto& kp : kps) {
+                if (kp.pt.x >= EDGE_THRESHOLD && kp.pt.y >= EDGE_THRESHOLD
+                    && kp.pt.x < image.cols - EDGE_THRESHOLD && kp.pt.y < image.rows - EDGE_THRESHOLD)
+                {
+                    kp.angle = computeICAngle(image, kp.pt, umax_);
+                    kp.size = PATCH_SIZE;
+                    kp.octave = 0;
+                    valid.push_back(kp);
+                }
+            }
+
+            if (!valid.empty()) {
+                levelOrbs_[level]->compute(image, valid, levelDescriptors[level]);
+            }
+
+            // back to the coordinates of the original image
+            for (auto& kp : valid) {
+                kp.pt *= scales[level];
+                kp.size *= scales[level];
+                kp.octave = level;
+            }
+            levelKeyPoints[level].swap(valid);
+        }
+    });
+
+    frame->keypoints_.clear();
+    frame->descriptors_ = Mat();
+    for (int level = 0; level < numLevels_; level++) {
+        if (levelKeyPoints[level].empty()) {
+            continue;
+        }
+        frame->keypoints_.insert(frame->keypoints_.end(), levelKeyPoints[level].begin(), levelKeyPoints[level].end());
+        frame->descriptors_.push_back(levelDescriptors[level]);
+    }
+}
+
+void FeatureExtractor::distributeKeyPoints(vector<vector<cv::KeyPoint>>& cellKeyPoints,
+                                           const int budget,
+                                           vector<cv::KeyPoint>& keypoints)
+{
+    size_t maxCellSize = 0;
+    for (auto& kps : cellKeyPoints) {
+        std::sort(kps.begin(), kps.end(),
+                  [](const cv::KeyPoint& k1, const cv::KeyPoint& k2) { return k1.response > k2.response; });
+        maxCellSize = max(maxCellSize, kps.size());
+    }
+
+    // the i-th best keypoint of every cell before the (i+1)-th best of any cell
+    keypoints.clear();
+    for (size_t rank = 0; rank < maxCellSize && (int)keypoints.size() < budget; rank++) {
+        for (auto& kps : cellKeyPoints) {
+            if (rank < kps.size()) {
+                keypoints.push_back(kps[rank]);
+                if ((int)keypoints.size() >= budget) {
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void FeatureExtractor::start(const FrameSource& source)
+{
+    source_ = source;
+    extractorRunning_ = true;
+    extractorThread_ = std::thread(std::bind(&FeatureExtractor::extractorLoop, this));
+}
+
+void FeatureExtractor::Stop()
+{
+    {
+        unique_lock<mutex> lock(extractorMutex_);
+        if (!extractorRunning_) {
+            return;
+        }
+        extractorRunning_ = false;
+    }
+    slotFree_.notify_all();
+    frameReady_.notify_all();
+    extractorThread_.join();
+}
+
+void FeatureExtractor::extractorLoop()
+{
+    while (true) {
+        {
+            unique_lock<mutex> lock(extractorMutex_);
+            slotFree_.wait(lock, [this] {
+                return !extractorRunning_ || readyFrames_.size() < pipelineDepth_;
+            });
+            if (!extractorRunning_) {
+                return;
+            }
+        }
+
+        // extract frame N+1 while the frontend is tracking frame N
+        Frame::Ptr frame = source_();
+        if (frame) {
+            extract(frame);
+        }
+
+        {
+            unique_lock<mutex> lock(extractorMutex_);
+            readyFrames_.push(frame);
+        }
+        frameReady_.notify_one();
+
+        if (frame == nullptr) {
+            return;
+        }
+    }
+}
+
+Frame::Ptr FeatureExtractor::next()
+{
+    Frame::Ptr frame;
+    {
+        unique_lock<mutex> lock(extractorMutex_);
+        frameReady_.wait(lock, [this] { return !readyFrames_.empty() || !extractorRunning_; });
+        if (readyFrames_.empty()) {
+            return nullptr;
+        }
+
+        frame = readyFrames_.front();
+        // keep the end marker so that later calls also return nullptr
+        if (frame) {
+            readyFrames_.pop();
+        }
+    }
+    slotFree_.notify_one();
+    return frame;
+}
+
+} // namespace
@@ -24,13 +24,15 @@
 namespace myslam
 {
 Frame::Frame()
-: id_(-1), time_stamp_(-1), camera_(nullptr)
+: id_(-1), time_stamp_(-1), camera_(nullptr), featuresExtracted_(false),
+  gridCellSize_(0), gridCols_(0), gridRows_(0)
 {
 
 }
 
 Frame::Frame ( long id, double time_stamp, SE3 T_c_w, Camera::Ptr camera, Mat color, Mat depth )
-: id_(id), time_stamp_(time_stamp), T_c_w_(T_c_w), camera_(camera), color_(color), depth_(depth)
+: id_(id), time_stamp_(time_stamp), T_c_w_(T_c_w), camera_(camera), color_(color), depth_(depth), featuresExtracted_(false),
+  gridCellSize_(0), gridCols_(0), gridRows_(0)
 {
 
 }
@@ -40,21 +42,38 @@ Frame::~Frame()
 
 }
 
-unsigned long Frame::factoryId_ = 0;
+Frame::Ptr Frame::createFrame( const unsigned long id )
+{
+    return allocate_shared<Frame>( PoolAllocator<Frame>(), id );
+}
 
-Frame::Ptr Frame::createFrame()
+Frame::Ptr Frame::restoreKeyFrame( const unsigned long id, const double time_stamp, const SE3& T_c_w, const Camera::Ptr& camera )
 {
-    return Frame::Ptr( new Frame(factoryId_++) );
+    return allocate_shared<Frame>( PoolAllocator<Frame>(), id, time_stamp, T_c_w, camera );
 }
 
-double Frame::findDepth ( const cv::KeyPoint& kp )
+double Frame::findDepth ( const cv::KeyPoint& kp ) const
 {
     int x = cvRound(kp.pt.x);
     int y = cvRound(kp.pt.y);
+
+    // the preprocessed depth already has the holes filled from the neighbours
+    if ( !depthMeters_.empty() )
+    {
+        if ( x < 0 || y < 0 || x >= depthMeters_.cols || y >= depthMeters_.rows ) {
+            return -1.0;
+        }
+        float d = depthMeters_.ptr<float>(y)[x];
+        return ( d > 0 ) ? d : -1.0;
+    }
+
+    if ( x < 0 || y < 0 || x >= depth_.cols || y >= depth_.rows ) {
+        return -1.0;
+    }
     ushort d = depth_.ptr<ushort>(y)[x];
     if ( d!=0 )
     {
-        return double(d)/camera_->depth_scale_;
+        return camera_->getRGBD().depthFromRaw(d);
     }
     else 
     {
@@ -63,25 +82,37 @@ double Frame::findDepth ( const cv::KeyPoint& kp )
         int dy[4] = {0,-1,0,1};
         for ( int i=0; i<4; i++ )
         {
-            d = depth_.ptr<ushort>( y+dy[i] )[x+dx[i]];
+            int nx = x+dx[i], ny = y+dy[i];
+            if ( nx < 0 || ny < 0 || nx >= depth_.cols || ny >= depth_.rows ) {
+                continue;
+            }
+            d = depth_.ptr<ushort>( ny )[nx];
             if ( d!=0 )
             {
-                return double(d)/camera_->depth_scale_;
+                return camera_->getRGBD().depthFromRaw(d);
             }
         }
     }
     return -1.0;
 }
 
+Vector3d Frame::backProject ( const cv::KeyPoint& kp, const double depth ) const
+{
+    if ( backProjection_ ) {
+        return backProjection_->backProject(kp.pt.x, kp.pt.y, depth);
+    }
+    return camera_->pixel2camera(kp.pt, depth);
+}
+
 
 Vector3d Frame::getCamCenter() const
 {
-    return T_c_w_.inverse().translation();
+    return getPose().inverse().translation();
 }
 
-bool Frame::isInFrame ( const Vector3d& pt_world )
+bool Frame::isInFrame ( const Vector3d& pt_world ) const
 {
-    Vector3d p_cam = camera_->world2camera( pt_world, T_c_w_ );
+    Vector3d p_cam = camera_->world2camera( pt_world, getPose() );
     if ( p_cam(2, 0) < 0 ) {
         return false;
     } 
@@ -91,97 +122,63 @@ bool Frame::isInFrame ( const Vector3d& pt_world )
         && pixel(1,0)<color_.rows;
 }
 
-void Frame::removeObservedMapPoint(const shared_ptr<MapPoint> mpt) {
-    unique_lock<mutex> lck(observationMutex_);
-
-    bool flag = false;
-    for (auto iter = observedMapPoints_.begin(); iter != observedMapPoints_.end(); iter++) {
-        if (iter->lock() == mpt) {
-            observedMapPoints_.erase(iter);
-            flag = true;
-            break;
-        }
-    }
-
-    if (flag) {
-        for (auto& pair: mpt->getKeyFrameObservationsMap()) {
-            auto otherKF = Map::getInstance().getKeyFrame(pair.first);
-
-            if ( otherKF == nullptr || otherKF->getId() == this->id_ ) {
-                continue;
-            }
+void Frame::assignKeyPointsToGrid ( const int cellSize )
+{
+    gridCellSize_ = cellSize;
+    gridCols_ = (color_.cols + cellSize - 1) / cellSize;
+    gridRows_ = (color_.rows + cellSize - 1) / cellSize;
+    keyPointGrid_.assign(gridCols_ * gridRows_, vector<size_t>());
 
-            this->decreaseConnectedKeyFrameWeightByOne(otherKF->getId());
-            otherKF->decreaseConnectedKeyFrameWeightByOne(this->id_);
+    for ( size_t i=0; i<keypoints_.size(); i++ )
+    {
+        int c = cvFloor(keypoints_[i].pt.x / cellSize);
+        int r = cvFloor(keypoints_[i].pt.y / cellSize);
+        if ( c<0 || r<0 || c>=gridCols_ || r>=gridRows_ ) {
+            continue;
         }
+        keyPointGrid_[r * gridCols_ + c].push_back(i);
     }
-
-    // if all the observations has been removed, consider this keyframe as outlier?
 }
 
-void Frame::decreaseConnectedKeyFrameWeightByOne(const unsigned long id) {
-    if (connectedKeyFrameIdToWeight_.count(id)) {
-        connectedKeyFrameIdToWeight_[id]--;
-        if (connectedKeyFrameIdToWeight_[id] < 15 
-            && connectedKeyFrameIdToWeight_.size() >= 2) {
-                connectedKeyFrameIdToWeight_.erase(id);
-            }
+vector<size_t> Frame::getKeyPointsInArea ( const float x, const float y, const float r ) const
+{
+    vector<size_t> indices;
+    if ( gridCellSize_ == 0 ) {
+        return indices;
     }
-}
 
-void Frame::updateConnectedKeyFrames() {
-    unique_lock<mutex> lck(connectedMutex_);
+    const int minCol = max(0, cvFloor((x - r) / gridCellSize_));
+    const int maxCol = min(gridCols_ - 1, cvFloor((x + r) / gridCellSize_));
+    const int minRow = max(0, cvFloor((y - r) / gridCellSize_));
+    const int maxRow = min(gridRows_ - 1, cvFloor((y + r) / gridCellSize_));
 
-    // Calcualte the co-visibliblity keyframes' weight
-    ConnectedKeyFrameIdToWeight connectedKeyFrameCandidates;
-    for(auto& mapPoint : observedMapPoints_) {
-        if (mapPoint.expired() || mapPoint.lock()->outlier_) {
-            continue;
-        }
-
-        for(auto& keyFrameMap : (mapPoint.lock())->getKeyFrameObservationsMap()) {
-
-            auto keyFrame = Map::getInstance().getKeyFrame(keyFrameMap.first);
-
-            if ( keyFrame == nullptr || keyFrame->getId() == id_) {
-                continue;
+    for ( int row=minRow; row<=maxRow; row++ )
+    {
+        for ( int col=minCol; col<=maxCol; col++ )
+        {
+            for ( auto idx : keyPointGrid_[row * gridCols_ + col] )
+            {
+                const cv::Point2f& pt = keypoints_[idx].pt;
+                if ( fabs(pt.x - x) <= r && fabs(pt.y - y) <= r ) {
+                    indices.push_back(idx);
+                }
             }
-
-            connectedKeyFrameCandidates[keyFrame->getId()]++;
         }
     }
-       
-    // Filter the connections whose weight larger than 15
-    connectedKeyFrameIdToWeight_.clear();
-    int maxWeight = 0;
-    unsigned long maxWeightConnectedKeyFrameId;
-
-    for(auto& pair : connectedKeyFrameCandidates) {
-        auto connectedKeyFrameId = pair.first;
-        auto connectedMapPointsCnt = pair.second;
-
-        if(connectedMapPointsCnt >= 15) {
-            connectedKeyFrameIdToWeight_[connectedKeyFrameId] = connectedMapPointsCnt;
-            Map::getInstance().getKeyFrame(connectedKeyFrameId)->addConnectedKeyFrame(this->id_, connectedMapPointsCnt);
-        }
+    return indices;
+}
 
-        if(connectedMapPointsCnt > maxWeight) {
-            maxWeightConnectedKeyFrameId = connectedKeyFrameId;
-            maxWeight = connectedMapPointsCnt;
-        }
-    }
+void Frame::removeObservedMapPoint(const shared_ptr<MapPoint> mpt) {
+    unique_lock<mutex> lck(observationMutex_);
 
-    // In case there is no weight larger than 15
-    if(connectedKeyFrameIdToWeight_.empty() && maxWeight != 0) {
-        connectedKeyFrameIdToWeight_[maxWeightConnectedKeyFrameId] = maxWeight;
-        Map::getInstance().getKeyFrame(maxWeightConnectedKeyFrameId)->addConnectedKeyFrame(this->id_, maxWeight);
+    // the covisibility weights are updated by the graph of the map
+    for (size_t i = 0; i < observedMapPoints_.size(); i++) {
+        if (observedMapPoints_[i].lock() == mpt) {
+            observedMapPoints_[i] = observedMapPoints_.back();
+            observedMapPoints_.pop_back();
+            break;
+        }
     }
-
-    // cout << "Current Keyframe Id: " << this->id_ << endl;
-    // cout << "Connected Keyframe counts: " << connectedKeyFrameIdToWeight_.size() << endl;
-    // for(auto& pair: connectedKeyFrameIdToWeight_) {
-    //     cout << "Id: " << pair.first << " Weight: " << pair.second << endl;
-    // }    
 }
 
 
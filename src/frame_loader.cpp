@@ -0,0 +1,127 @@
+#include <fstream>
+#include <opencv2/imgcodecs.hpp>
+
+#include "myslam/frame_loader.h"
+#include "myslam/config.h"
+
+namespace myslam {
+
+FrameLoader::FrameLoader(const string& datasetDir, const Camera::Ptr& camera, const unsigned long firstFrameId)
+: opened_(false), camera_(camera), firstFrameId_(firstFrameId), loaderRunning_(false), nextToDecode_(0), nextToDeliver_(0)
+{
+    ifstream fin ( datasetDir+"/associate.txt" );
+    if ( !fin ) {
+        return;
+    }
+
+    while ( !fin.eof() )
+    {
+        string rgb_time, rgb_file, depth_time, depth_file;
+        fin>>rgb_time>>rgb_file>>depth_time>>depth_file;
+        rgbTimes_.push_back ( atof ( rgb_time.c_str() ) );
+        rgbFiles_.push_back ( datasetDir+"/"+rgb_file );
+        depthFiles_.push_back ( datasetDir+"/"+depth_file );
+
+        if ( fin.good() == false )
+            break;
+    }
+    fin.close();
+    opened_ = true;
+
+    prefetchFrames_ = max(1, Config::get<int>("prefetch_frames"));
+    depthPreprocessor_ = DepthPreprocessor::Ptr(new DepthPreprocessor(camera_));
+    int threadNum = max(1, Config::get<int>("loader_threads"));
+
+    loaderRunning_ = true;
+    for (int i = 0; i < threadNum; i++) {
+        loaderThreads_.push_back(std::thread(std::bind(&FrameLoader::loaderLoop, this)));
+    }
+}
+
+void FrameLoader::Stop() {
+    {
+        unique_lock<mutex> lock(loaderMutex_);
+        loaderRunning_ = false;
+    }
+    slotFree_.notify_all();
+    frameReady_.notify_all();
+
+    for (auto& t : loaderThreads_) {
+        t.join();
+    }
+    loaderThreads_.clear();
+}
+
+void FrameLoader::loaderLoop() {
+    while (true) {
+        size_t idx;
+        {
+            unique_lock<mutex> lock(loaderMutex_);
+            // wait until the consumer leaves room in the prefetch window
+            slotFree_.wait(lock, [this] {
+                return !loaderRunning_
+                    || nextToDecode_ >= rgbFiles_.size()
+                    || nextToDecode_ < nextToDeliver_ + size_t(prefetchFrames_);
+            });
+
+            if (!loaderRunning_ || nextToDecode_ >= rgbFiles_.size()) {
+                return;
+            }
+            idx = nextToDecode_++;
+        }
+
+        // decode outside the lock, this is what we want to overlap with tracking
+        DecodedImages images;
+        images.color = cv::imread ( rgbFiles_[idx] );
+        images.depth = cv::imread ( depthFiles_[idx], -1 );
+        if ( images.depth.data != nullptr ) {
+            depthPreprocessor_->process(images.depth, images.depthMeters);
+        }
+
+        {
+            unique_lock<mutex> lock(loaderMutex_);
+            decoded_[idx] = images;
+        }
+        frameReady_.notify_all();
+    }
+}
+
+Frame::Ptr FrameLoader::next() {
+    DecodedImages images;
+    size_t idx;
+    {
+        unique_lock<mutex> lock(loaderMutex_);
+        if (nextToDeliver_ >= rgbFiles_.size()) {
+            return nullptr;
+        }
+
+        frameReady_.wait(lock, [this] {
+            return !loaderRunning_ || decoded_.count(nextToDeliver_);
+        });
+
+        if (!decoded_.count(nextToDeliver_)) {
+            return nullptr;
+        }
+
+        idx = nextToDeliver_++;
+        images = decoded_[idx];
+        decoded_.erase(idx);
+    }
+    slotFree_.notify_all();
+
+    if ( images.color.data==nullptr || images.depth.data==nullptr ) {
+        return nullptr;
+    }
+
+    // frames are created here so that ids follow the dataset order
+    Frame::Ptr frame = Frame::createFrame(firstFrameId_ + idx);
+    frame->camera_ = camera_;
+    frame->color_ = images.color;
+    // the raw depth is not kept, the keyframes would hold both images
+    frame->depthMeters_ = images.depthMeters;
+    frame->backProjection_ = depthPreprocessor_->getBackProjectionTable(images.depth.cols, images.depth.rows);
+    frame->time_stamp_ = rgbTimes_[idx];
+    return frame;
+}
+
+} // namespace
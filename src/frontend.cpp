@@ -4,60 +4,166 @@
 
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
-#include <opencv2/calib3d/calib3d.hpp>
 #include <algorithm>
 #include <boost/timer.hpp>
 
 #include "myslam/config.h"
 #include "myslam/frontend.h"
-#include "myslam/g2o_types.h"
 #include "myslam/util.h"
 #include "myslam/map.h"
+#include "myslam/hamming.h"
+#include "myslam/profiler.h"
+#ifdef MYSLAM_WITH_VIEWER
+#include "myslam/viewer.h"
+#endif
 
 
 namespace myslam
 {
 
-    FrontEnd::FrontEnd() : state_(INITIALIZING), frameRef_(nullptr), frameCurr_(nullptr), accuLostFrameNums_(0), num_inliers_(0),
-                           flannMatcher_(new cv::flann::LshIndexParams(5, 10, 2))
+    FrontEnd::FrontEnd(const Map::Ptr& map) : map_(map), state_(INITIALIZING), frameRef_(nullptr), frameCurr_(nullptr), accuLostFrameNums_(0), num_inliers_(0), poseFromPnP_(false), backendSync_(false)
     {
-        orb_ = cv::ORB::create(Config::get<int>("number_of_features"),
-                               Config::get<double>("scale_factor"),
-                               Config::get<int>("level_pyramid"));
+        extractor_ = FeatureExtractor::Ptr(new FeatureExtractor);
+        pnpRansac_ = PnPRansac::Ptr(new PnPRansac);
+        poseOptimizer_ = PoseOptimizer::Ptr(new PoseOptimizer);
         minDisRatio_ = Config::get<float>("match_ratio");
         maxLostFrames_ = Config::get<float>("max_num_lost");
         min_inliers_ = Config::get<int>("min_inliers");
         keyFrameMinRot_ = Config::get<double>("keyframe_rotation");
         keyFrameMinTrans_ = Config::get<double>("keyframe_translation");
+        keyFrameSpacing_ = 1.0;
+        guidedMatching_ = Config::get<int>("guided_matching");
+        keyPointGridSize_ = max(1, Config::get<int>("keypoint_grid_size"));
+        guidedSearchRadius_ = Config::get<float>("guided_search_radius");
+        guidedMaxDistance_ = Config::get<int>("guided_max_distance");
+        guidedMatchRatio_ = Config::get<float>("guided_match_ratio");
+        guidedMinMatches_ = Config::get<int>("guided_min_matches");
+        useMotionModel_ = Config::get<int>("motion_model");
+        predictedSearchRadius_ = Config::get<float>("guided_search_radius_predicted");
+        searchRadius_ = guidedSearchRadius_;
+        trackingMode_ = TrackingMode(Config::get<int>("tracking_mode"));
+        directKeyFrameRatio_ = Config::get<float>("direct_keyframe_valid_ratio");
+        flowKeyFrameRatio_ = Config::get<float>("flow_keyframe_ratio");
+        if (trackingMode_ == TRACKING_DIRECT)
+        {
+            directTracker_ = DirectTracker::Ptr(new DirectTracker);
+        }
+        else if (trackingMode_ == TRACKING_FLOW)
+        {
+            flowTracker_ = OpticalFlowTracker::Ptr(new OpticalFlowTracker);
+        }
+        if (Config::get<int>("latency_control"))
+        {
+            latencyController_ = LatencyController::Ptr(new LatencyController);
+        }
 
         cout << "Frontend status: -1: Initialization, 0: Tracking, 1: Lost" << endl;
     }
 
     bool FrontEnd::addFrame(Frame::Ptr frame)
     {
-        cout << "Frontend status: " << state_ << endl;
+        const auto start = std::chrono::steady_clock::now();
         frameCurr_ = frame;
+        const bool tracked = trackFrame();
+        if (latencyController_)
+        {
+            adaptToLatency(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        return tracked;
+    }
+
+    void FrontEnd::adaptToLatency(const double frameMs)
+    {
+        // the pipelined extraction is off the tracking thread, the slower stage bounds the rate
+        double latencyMs = frameMs;
+        if (extractor_->isPipelined())
+        {
+            latencyMs = max(frameMs, extractor_->getLastExtractionMs());
+        }
+        // the direct alignment has no inliers, its frames give no quality input
+        int inliers = 0;
+        if (state_ == TRACKING && accuLostFrameNums_ == 0)
+        {
+            inliers = LatencyController::NO_INLIERS;
+            if (poseFromPnP_)
+            {
+                inliers = num_inliers_;
+            }
+        }
+        if (latencyController_->update(latencyMs, inliers))
+        {
+            const LatencyController::Budget& budget = latencyController_->getBudget();
+            extractor_->setBudget(budget.numFeatures, budget.numLevels);
+            pnpRansac_->setMaxIterations(budget.ransacIterations);
+            keyFrameSpacing_ = budget.keyFrameSpacing;
+        }
+        Profiler::getInstance().setCounter(Profiler::COUNTER_FEATURE_BUDGET, latencyController_->getBudget().numFeatures);
+    }
+
+    bool FrontEnd::trackFrame()
+    {
+        ScopedTimer timer(Profiler::STAGE_TRACK);
+        cout << "Frontend status: " << state_ << endl;
+        poseFromPnP_ = false;
 
         switch (state_)
         {
         case INITIALIZING:
         {
-            // RGBD camera only needs 1 frame to configure since it could get the depth information
-            state_ = TRACKING;
-
             // extract features from frameCurr_
             extractKeyPointsAndComputeDescriptors();
 
+            // with a prebuilt map, the first frame is localized in it instead of starting a new map
+            if (map_->getActiveMappointsSize() > 0)
+            {
+                if (!relocalize())
+                {
+                    cout << "Relocalization in the loaded map failed" << endl;
+                    return false;
+                }
+                state_ = TRACKING;
+                break;
+            }
+
+            // RGBD camera only needs 1 frame to configure since it could get the depth information
+            state_ = TRACKING;
+
             // the first frame is a key-frame
-            Map::getInstance().insertKeyFrame(frameCurr_);
+            map_->insertKeyFrame(frameCurr_);
             initMap();
-            frameRef_ = frame;
+            frameRef_ = frameCurr_;
+            setTrackingReference();
+            motionModel_.update(frameCurr_->time_stamp_, frameCurr_->getPose());
             break;
         }
         case TRACKING:
         {
             // set an initial pose, used for looking for map points in current view
-            frameCurr_->setPose(frameRef_->getPose());
+            predictPose();
+
+            // the direct alignment or the optical flow track the frames between the keyframes
+            // against the reference keyframe without features, a keyframe or a failed tracking
+            // goes through the feature matching
+            bool fastTracked = false;
+            bool lowOverlap = false;   // too little of the reference left in view
+            SE3 fastPose;
+            if (trackingMode_ != TRACKING_FEATURES)
+            {
+                fastTracked = (trackingMode_ == TRACKING_DIRECT) ? trackDirect(lowOverlap) : trackOpticalFlow(lowOverlap);
+                fastPose = estimatedPoseCurr_;
+                if (fastTracked && !lowOverlap && !isKeyFrame())
+                {
+                    matchedKptSet_.clear();
+                    acceptPose(fastPose);
+                    break;
+                }
+                if (fastTracked)
+                {
+                    // the tracked pose is close, start the matching from it with the small window
+                    frameCurr_->setPose(fastPose);
+                    searchRadius_ = predictedSearchRadius_;
+                }
+            }
 
             extractKeyPointsAndComputeDescriptors();
             matchKeyPointsWithActiveMapPoints();
@@ -66,25 +172,29 @@ namespace myslam
             // bad estimation due to various reasons
             if (!isGoodEstimation())
             {
+                if (fastTracked)
+                {
+                    // keep the tracked pose, the keyframe is tried again with the next frame
+                    cout << "Cannot estimate Pose of the keyframe, keep the tracked pose" << endl;
+                    acceptPose(fastPose);
+                    break;
+                }
                 cout << "Cannot estimate Pose" << endl;
                 accuLostFrameNums_++;
                 state_ = (++accuLostFrameNums_ > maxLostFrames_) ? LOST : TRACKING;
+                // the velocity is unreliable after a failure, restart from the last tracked pose
+                motionModel_.reset();
                 return false;
             }
 
-            // if good estimation, reset the num of lost
-            accuLostFrameNums_ = 0;
-
-            // set estimated pose to current frame
-            frameCurr_->setPose(estimatedPoseCurr_);
+            // if good estimation, reset the num of lost, set estimated pose to current frame
+            // and remove non-active mappoints
+            acceptPose(estimatedPoseCurr_);
 
-            // remove non-active mappoints
-            cullNonActiveMapPoints();
-
-            if ( isKeyFrame() )
+            if ( isKeyFrame() || lowOverlap )
             {
                 cout << "  Current frame is a new keyframe" << endl;
-                Map::getInstance().insertKeyFrame(frameCurr_);
+                map_->insertKeyFrame(frameCurr_);
 
                 // Add this keyframe as the observation of observed mappoints
                 addKeyframeObservationToOldMapPoints();
@@ -97,11 +207,14 @@ namespace myslam
                 
                 // if have backend, use backend to optimize mappoints position and frame pose
                 if (backend_) {
-                    frameCurr_->updateConnectedKeyFrames();
-                    backend_->optimizeCovisibilityGraph(frameCurr_);
+                    shared_future<void> optimized = backend_->optimizeCovisibilityGraph(frameCurr_);
+                    if (backendSync_) {
+                        optimized.wait();
+                    }
                 }
 
                 frameRef_ = frameCurr_;
+                setTrackingReference();
             }
             break;
         }
@@ -112,52 +225,194 @@ namespace myslam
         }
         }
 
-        viewer_->setCurrentFrame(frameCurr_, matchedKptSet_);
-        viewer_->updateDrawingObjects();
+#ifdef MYSLAM_WITH_VIEWER
+        if (viewer_)
+        {
+            ScopedTimer viewerTimer(Profiler::STAGE_VIEWER_SYNC);
+            viewer_->setCurrentFrame(frameCurr_, make_shared<const KeyPointSet>(matchedKptSet_));
+        }
+#endif
+
+        return true;
+    }
+
+    void FrontEnd::predictPose()
+    {
+        SE3 T_c_w = frameRef_->getPose();
+        bool predicted = false;
+        if (useMotionModel_ && motionModel_.hasPose())
+        {
+            predicted = motionModel_.predict(frameCurr_->time_stamp_, T_c_w);
+        }
+        frameCurr_->setPose(T_c_w);
+
+        // a predicted pose is close enough for a smaller guided search window
+        searchRadius_ = predicted ? predictedSearchRadius_ : guidedSearchRadius_;
+    }
+
+    bool FrontEnd::trackDirect(bool& lowOverlap)
+    {
+        ScopedTimer timer(Profiler::STAGE_DIRECT_ALIGN);
+        estimatedPoseCurr_ = frameCurr_->getPose();
+        if (!directTracker_->track(frameCurr_, estimatedPoseCurr_))
+        {
+            cout << "  Direct alignment failed, use the features" << endl;
+            return false;
+        }
+        if (!isSmallMotion())
+        {
+            return false;
+        }
+        lowOverlap = directTracker_->getValidRatio() < directKeyFrameRatio_;
+        return true;
+    }
+
+    bool FrontEnd::trackOpticalFlow(bool& lowOverlap)
+    {
+        int tracked;
+        {
+            ScopedTimer timer(Profiler::STAGE_OPTICAL_FLOW);
+            tracked = flowTracker_->track(frameCurr_, poseCorrespondences_);
+        }
+        cout << "  Optical flow tracked keypoints: " << tracked << " of " << flowTracker_->getReferenceSize() << endl;
+        Profiler::getInstance().setCounter(Profiler::COUNTER_MATCHES, tracked);
 
+        // same pose estimation as estimatePosePnP on the tracked keypoints
+        poseFromPnP_ = true;
+        num_inliers_ = 0;
+        if (tracked >= 4)
+        {
+            ScopedTimer timer(Profiler::STAGE_PNP_RANSAC);
+            num_inliers_ = pnpRansac_->estimate(poseCorrespondences_, frameCurr_->camera_, frameCurr_->getPose(),
+                                                estimatedPoseCurr_, poseInliers_);
+        }
+        if (num_inliers_ > 0)
+        {
+            ScopedTimer timer(Profiler::STAGE_MOTION_BA);
+            num_inliers_ = poseOptimizer_->optimize(poseCorrespondences_, frameCurr_->camera_, estimatedPoseCurr_, poseInliers_);
+        }
+        Profiler::getInstance().setCounter(Profiler::COUNTER_INLIERS, num_inliers_);
+
+        if (num_inliers_ < min_inliers_)
+        {
+            cout << "  Optical flow tracking failed with " << num_inliers_ << " inliers, use the features" << endl;
+            return false;
+        }
+        if (!isSmallMotion())
+        {
+            return false;
+        }
+        lowOverlap = num_inliers_ < flowKeyFrameRatio_ * flowTracker_->getReferenceSize();
         return true;
     }
 
+    void FrontEnd::setTrackingReference()
+    {
+        if (directTracker_)
+        {
+            directTracker_->setReference(frameRef_);
+        }
+        if (flowTracker_)
+        {
+            flowTracker_->setReference(frameRef_);
+        }
+    }
+
+    void FrontEnd::acceptPose(const SE3& pose)
+    {
+        accuLostFrameNums_ = 0;
+        frameCurr_->setPose(pose);
+        motionModel_.update(frameCurr_->time_stamp_, pose);
+        cullNonActiveMapPoints();
+    }
+
     void FrontEnd::extractKeyPointsAndComputeDescriptors()
     {
-        orb_->detectAndCompute(frameCurr_->color_, Mat(), keypointsCurr_, descriptorsCurr_);
+        // frames coming from the pipelined extraction stage already have features
+        if (!frameCurr_->featuresExtracted_)
+        {
+            extractor_->extract(frameCurr_);
+        }
+        keypointsCurr_ = frameCurr_->keypoints_;
+        descriptorsCurr_ = frameCurr_->descriptors_;
+
+        if (guidedMatching_)
+        {
+            frameCurr_->assignKeyPointsToGrid(keyPointGridSize_);
+        }
     }
 
     void FrontEnd::matchKeyPointsWithActiveMapPoints()
     {
-        // get the active mappoints candidates from map
-        auto activeMpts = Map::getInstance().getActiveMappoints();
-        if (activeMpts.size() < 100)
+        ScopedTimer timer(Profiler::STAGE_MATCH);
+
+        // as before the spatial index, the reset depends on the whole active set: a sparse
+        // view alone does not re-activate the map
+        if (map_->getActiveMappointsSize() < 100)
         {
-            Map::getInstance().resetActiveMappoints();
-            activeMpts = Map::getInstance().getAllMappoints();
+            map_->resetActiveMappoints();
             cout << " Not enough active mappoints, reset activie mappoints to all mappoints" << endl;
         }
 
+        // get the active mappoints in the view of current frame from the spatial index of map
+        auto mptsInView = map_->getMappointsInView(frameCurr_, true);
+
         // Select the good mappoints candidates
         vector<MapPoint::Ptr> mptCandidates;
-        Mat descriptorCandidates;
-        for (auto &mappoint : activeMpts)
+        for (auto &mp : mptsInView)
         {
-            auto mp = mappoint.second;
-
             // If considered as outlier by backend
             if (mp->outlier_)
             {
                 continue;
             }
 
-            if (frameCurr_->isInFrame(mp->getPosition()))
+            // add to candidate
+            mp->visibleTimes_++;
+            mptCandidates.push_back(mp);
+        }
+        Profiler::getInstance().setCounter(Profiler::COUNTER_CANDIDATES, mptCandidates.size());
+
+        matchedMptKptMap_.clear();
+        matchedKptSet_.clear();
+
+        vector<cv::DMatch> matches;
+        if (guidedMatching_)
+        {
+            matchByProjection(mptCandidates, matches);
+            if ((int)matches.size() < guidedMinMatches_)
+            {
+                cout << "  Not enough guided matches: " << matches.size() << ", use brute-force matching" << endl;
+                matches.clear();
+            }
+        }
+
+        if (matches.empty() && !mptCandidates.empty() && !keypointsCurr_.empty())
+        {
+            matchBruteForce(mptCandidates, matches);
+            if (matches.empty())
             {
-                // add to candidate
-                mp->visibleTimes_++;
-                mptCandidates.push_back(mp);
-                descriptorCandidates.push_back(mp->descriptor_);
+                return;
             }
+            selectGoodMatches(matches);
         }
 
-        vector<cv::DMatch> matches;
-        flannMatcher_.match(descriptorCandidates, descriptorsCurr_, matches);
+        for (cv::DMatch &m : matches)
+        {
+            matchedMptKptMap_[mptCandidates[m.queryIdx]] = keypointsCurr_[m.trainIdx];
+            matchedKptSet_.insert(keypointsCurr_[m.trainIdx]);
+        }
+        cout << "  Active mappoints size: " << mptCandidates.size() << endl;
+        cout << "  Matched feature paris size: " << matchedMptKptMap_.size() << endl;
+        Profiler::getInstance().setCounter(Profiler::COUNTER_MATCHES, matchedMptKptMap_.size());
+    }
+
+    void FrontEnd::selectGoodMatches(vector<cv::DMatch>& matches)
+    {
+        if (matches.empty())
+        {
+            return;
+        }
         // select the best matches
         float min_dis = std::min_element(
                             matches.begin(),
@@ -165,89 +420,198 @@ namespace myslam
                             [](const cv::DMatch &m1, const cv::DMatch &m2) { return m1.distance < m2.distance; })
                             ->distance;
 
+        vector<cv::DMatch> goodMatches;
+        for (cv::DMatch &m : matches)
+        {
+            if (m.distance < max<float>(min_dis * minDisRatio_, 30.0))
+            {
+                goodMatches.push_back(m);
+            }
+        }
+        matches.swap(goodMatches);
+    }
+
+    bool FrontEnd::relocalize()
+    {
+        // there is no pose yet to select the mappoints in view, match against all of them
+        auto allMpts = map_->getAllMappoints();
+        vector<MapPoint::Ptr> mptCandidates;
+        for (auto &mp : *allMpts)
+        {
+            if (!mp.second->outlier_)
+            {
+                mptCandidates.push_back(mp.second);
+            }
+        }
+
         matchedMptKptMap_.clear();
         matchedKptSet_.clear();
+        vector<cv::DMatch> matches;
+        if (!mptCandidates.empty() && !keypointsCurr_.empty())
+        {
+            ScopedTimer timer(Profiler::STAGE_MATCH);
+            matchBruteForce(mptCandidates, matches);
+            selectGoodMatches(matches);
+        }
         for (cv::DMatch &m : matches)
         {
-            if (m.distance < max<float>(min_dis * minDisRatio_, 30.0))
+            matchedMptKptMap_[mptCandidates[m.queryIdx]] = keypointsCurr_[m.trainIdx];
+            matchedKptSet_.insert(keypointsCurr_[m.trainIdx]);
+        }
+        cout << "  Relocalization matches: " << matchedMptKptMap_.size() << " of " << mptCandidates.size() << " mappoints" << endl;
+
+        estimatePosePnP();
+        if (num_inliers_ < min_inliers_)
+        {
+            return false;
+        }
+
+        // the frame becomes the first keyframe of this run, attached to the loaded map
+        frameCurr_->setPose(estimatedPoseCurr_);
+        map_->insertKeyFrame(frameCurr_);
+        addKeyframeObservationToOldMapPoints();
+        addNewMapPoints();
+        frameRef_ = frameCurr_;
+        setTrackingReference();
+        motionModel_.update(frameCurr_->time_stamp_, estimatedPoseCurr_);
+        return true;
+    }
+
+    void FrontEnd::matchByProjection(const vector<MapPoint::Ptr>& mptCandidates, vector<cv::DMatch>& matches)
+    {
+        // project all the candidates with the initial pose at once
+        projectionBatch_.clear();
+        for (auto &mp : mptCandidates)
+        {
+            projectionBatch_.add(mp->getPosition(), mp->norm_);
+        }
+        frameCurr_->projectBatch(projectionBatch_);
+
+        // best mappoint of each keypoint, a keypoint can only be matched once
+        vector<int> bestMptOfKpt(keypointsCurr_.size(), -1);
+        vector<int> bestDistOfKpt(keypointsCurr_.size(), 256);
+
+        for (size_t i = 0; i < mptCandidates.size(); i++)
+        {
+            auto &mp = mptCandidates[i];
+            if (projectionBatch_.depth[i] <= 0)
+            {
+                continue;
+            }
+
+            int bestDist = 256, secondDist = 256, bestIdx = -1;
+            for (auto idx : frameCurr_->getKeyPointsInArea(projectionBatch_.u[i], projectionBatch_.v[i], searchRadius_))
+            {
+                int dist = hammingDistance(mp->descriptor_, descriptorsCurr_.ptr<uchar>(idx));
+                if (dist < bestDist)
+                {
+                    secondDist = bestDist;
+                    bestDist = dist;
+                    bestIdx = idx;
+                }
+                else if (dist < secondDist)
+                {
+                    secondDist = dist;
+                }
+            }
+
+            if (bestIdx < 0 || bestDist > guidedMaxDistance_ || bestDist > guidedMatchRatio_ * secondDist)
+            {
+                continue;
+            }
+
+            if (bestDist < bestDistOfKpt[bestIdx])
             {
-                matchedMptKptMap_[mptCandidates[m.queryIdx]] = keypointsCurr_[m.trainIdx];
-                matchedKptSet_.insert(keypointsCurr_[m.trainIdx]);
+                bestDistOfKpt[bestIdx] = bestDist;
+                bestMptOfKpt[bestIdx] = i;
+            }
+        }
+
+        matches.clear();
+        for (size_t idx = 0; idx < keypointsCurr_.size(); idx++)
+        {
+            if (bestMptOfKpt[idx] >= 0)
+            {
+                matches.push_back(cv::DMatch(bestMptOfKpt[idx], idx, bestDistOfKpt[idx]));
+            }
+        }
+    }
+
+    void FrontEnd::matchBruteForce(const vector<MapPoint::Ptr>& mptCandidates, vector<cv::DMatch>& matches)
+    {
+        // best keypoint of each candidate, read directly from the descriptor pool
+        vector<cv::DMatch> bestMatches(mptCandidates.size());
+        const uchar* train = descriptorsCurr_.ptr<uchar>(0);
+        const size_t step = descriptorsCurr_.step;
+        const int n = descriptorsCurr_.rows;
+        parallelFor(0, mptCandidates.size(), [&](const cv::Range& range) {
+            for (int i = range.start; i < range.end; i++)
+            {
+                int bestDist, secondDist;
+                int bestIdx = searchBestMatch(mptCandidates[i]->descriptor_, train, step, n, bestDist, secondDist);
+                bestMatches[i] = cv::DMatch(i, bestIdx, bestDist);
+            }
+        });
+
+        matches.clear();
+        for (auto &m : bestMatches)
+        {
+            if (m.trainIdx >= 0)
+            {
+                matches.push_back(m);
             }
         }
-        cout << "  Active mappoints size: " << mptCandidates.size() << endl;
-        cout << "  Matched feature paris size: " << matchedMptKptMap_.size() << endl;
     }
 
     void FrontEnd::estimatePosePnP()
     {
+        poseFromPnP_ = true;
         // construct the 3d 2d observations
         vector<MapPoint::Ptr> mpts3d;
-        vector<cv::Point3f> pts3d;
-        vector<cv::Point2f> pts2d;
-
+        poseCorrespondences_.clear();
         for (auto &pair : matchedMptKptMap_)
         {
             mpts3d.push_back(pair.first);
-            pts3d.push_back(toPoint3f(pair.first->getPosition()));
-            pts2d.push_back(pair.second.pt);
+            poseCorrespondences_.add(pair.first->getPosition(), pair.second.pt);
+        }
+
+        // P3P needs at least 4 points
+        if (mpts3d.size() < 4)
+        {
+            num_inliers_ = 0;
+            return;
         }
 
-        // use P3P wih Ransac to solve an intial value of the pose
-        Mat K = frameCurr_->camera_->getCameraMatrix();
-        Mat rvec, tvec, inliers;
-        cv::solvePnPRansac(pts3d, pts2d, K, Mat(), rvec, tvec, false, 100, 4.0, 0.99, inliers, cv::SOLVEPNP_P3P);
+        // RANSAC starting from the initial pose of the frame
+        {
+            ScopedTimer timer(Profiler::STAGE_PNP_RANSAC);
+            num_inliers_ = pnpRansac_->estimate(poseCorrespondences_, frameCurr_->camera_, frameCurr_->getPose(),
+                                                estimatedPoseCurr_, poseInliers_);
+        }
 
-        num_inliers_ = inliers.rows;
         cout << "  PNP results inlier size: " << num_inliers_ << endl;
+        if (num_inliers_ == 0)
+        {
+            return;
+        }
+
+        // using motion-only bundle adjustment to optimize the pose, starting from the RANSAC inliers
+        ScopedTimer timer(Profiler::STAGE_MOTION_BA);
+        num_inliers_ = poseOptimizer_->optimize(poseCorrespondences_, frameCurr_->camera_, estimatedPoseCurr_, poseInliers_);
+        cout << "  Motion-only BA inlier size: " << num_inliers_ << endl;
+        Profiler::getInstance().setCounter(Profiler::COUNTER_INLIERS, num_inliers_);
 
-        // Covert rotation vector to matrix
-        Mat R;
-        cv::Rodrigues(rvec, R);
-        Eigen::Matrix3d R_eigen;
-        R_eigen << R.at<double>(0, 0), R.at<double>(0, 1), R.at<double>(0, 2),
-            R.at<double>(1, 0), R.at<double>(1, 1), R.at<double>(1, 2),
-            R.at<double>(2, 0), R.at<double>(2, 1), R.at<double>(2, 2);
-        estimatedPoseCurr_ = SE3(
-            R_eigen,
-            Vector3d(tvec.at<double>(0, 0), tvec.at<double>(1, 0), tvec.at<double>(2, 0)));
-
-        // using motion-only bundle adjustment to optimize the pose
-        typedef g2o::BlockSolver_6_3 BlockSolverType;
-        typedef g2o::LinearSolverDense<BlockSolverType::PoseMatrixType> LinearSolverType;
-
-        auto solver = new g2o::OptimizationAlgorithmLevenberg(
-            g2o::make_unique<BlockSolverType>(g2o::make_unique<LinearSolverType>()));
-
-        g2o::SparseOptimizer optimizer;
-        optimizer.setAlgorithm(solver);
-
-        VertexPose *pose = new VertexPose();
-        pose->setId(0);
-        pose->setEstimate(estimatedPoseCurr_);
-        optimizer.addVertex(pose);
-
-        // edges
-        for (int i = 0; i < inliers.rows; i++)
-        {
-            int index = inliers.at<int>(i, 0);
-            // 3D -> 2D projection
-            UnaryEdgeProjection *edge = new UnaryEdgeProjection(toVec3d(pts3d[index]), frameCurr_->camera_);
-            edge->setId(i);
-            edge->setVertex(0, pose);
-            edge->setMeasurement(toVec2d(pts2d[index]));
-            edge->setInformation(Eigen::Matrix2d::Identity());
-            optimizer.addEdge(edge);
+        for (size_t i = 0; i < mpts3d.size(); i++)
+        {
+            if (!poseInliers_[i])
+            {
+                continue;
+            }
             // increase the inlier mappoints matched times
-            mpts3d[index]->matchedTimes_++;
+            mpts3d[i]->matchedTimes_++;
             // set this mappoint as the observed mappoints of current frame
-            frameCurr_->addObservedMapPoint(mpts3d[index]);
+            frameCurr_->addObservedMapPoint(mpts3d[i]);
         }
-
-        optimizer.initializeOptimization();
-        optimizer.optimize(10);
-
-        estimatedPoseCurr_ = pose->estimate();
     }
 
     bool FrontEnd::isGoodEstimation()
@@ -258,6 +622,11 @@ namespace myslam
             cout << "Current tracking is rejected because inlier is too small: " << num_inliers_ << endl;
             return false;
         }
+        return isSmallMotion();
+    }
+
+    bool FrontEnd::isSmallMotion()
+    {
         // check if the motion is too large
         SE3 T_r_c = frameRef_->getPose() * estimatedPoseCurr_.inverse();
         Sophus::Vector6d d = T_r_c.log();
@@ -275,7 +644,7 @@ namespace myslam
         Sophus::Vector6d d = T_r_c.log();
         Vector3d trans = d.head<3>();
         Vector3d rot = d.tail<3>();
-        if (rot.norm() > keyFrameMinRot_ || trans.norm() > keyFrameMinTrans_) {
+        if (rot.norm() > keyFrameSpacing_ * keyFrameMinRot_ || trans.norm() > keyFrameSpacing_ * keyFrameMinTrans_) {
             return true;
         }
         return false;
@@ -291,14 +660,18 @@ namespace myslam
 
     void FrontEnd::cullNonActiveMapPoints()
     {
-        Map::getInstance().cullNonActiveMapPoints(frameCurr_);
-        Map::getInstance().updateMappointEraseRatio();
+        ScopedTimer timer(Profiler::STAGE_CULLING);
+        map_->cullNonActiveMapPoints(frameCurr_);
+        map_->updateMappointEraseRatio();
 
-        cout << "  Active mappoints size after culling: " << Map::getInstance().getActiveMappoints().size() << endl;
+        size_t activeSize = map_->getActiveMappointsSize();
+        cout << "  Active mappoints size after culling: " << activeSize << endl;
+        Profiler::getInstance().setCounter(Profiler::COUNTER_ACTIVE_MAPPOINTS, activeSize);
     }
 
     void FrontEnd::addNewMapPoints()
     {
+        size_t activeSize = map_->getActiveMappointsSize();
         for (size_t i = 0; i < keypointsCurr_.size(); i++)
         {
             // if the keypoint doesn't match with previous mappoints, this is a new mappoint
@@ -307,8 +680,11 @@ namespace myslam
                 addNewMapPoint(i);
             }
         }
-        Map::getInstance().updateMappointEraseRatio();
-        cout << "  Active mappoints size after adding: " << Map::getInstance().getActiveMappoints().size() << endl;
+        map_->updateMappointEraseRatio();
+        size_t newActiveSize = map_->getActiveMappointsSize();
+        cout << "  Active mappoints size after adding: " << newActiveSize << endl;
+        Profiler::getInstance().setCounter(Profiler::COUNTER_NEW_MAPPOINTS, newActiveSize - activeSize);
+        Profiler::getInstance().setCounter(Profiler::COUNTER_ACTIVE_MAPPOINTS, newActiveSize);
     }
 
     void FrontEnd::addNewMapPoint(const int &idx)
@@ -319,23 +695,25 @@ namespace myslam
             return;
         }
 
-        Vector3d mptPos = frameCurr_->camera_->pixel2world(
-            keypointsCurr_[idx], frameCurr_->getPose(), depth);
+        Vector3d mptPos = frameCurr_->getPose().inverse() * frameCurr_->backProject(keypointsCurr_[idx], depth);
 
         // Create a mappoint
-        // deep copy the descriptor and keypoint position since they will be clear in next track
+        // the descriptor is copied into the descriptor pool of the map
         MapPoint::Ptr mpt = MapPoint::createMapPoint(
+            map_->createMapPointId(),
             mptPos,
             (mptPos - frameCurr_->getCamCenter()).normalized(),
-            descriptorsCurr_.row(idx).clone(),
+            descriptorsCurr_.row(idx),
             frameCurr_->getId(),
-            cv::Point2f(keypointsCurr_[idx].pt));
+            cv::Point2f(keypointsCurr_[idx].pt),
+            map_->getDescriptorPool(),
+            map_->getCovisibilityGraph());
 
         // set this mappoint as the observed mappoints of current frame
         frameCurr_->addObservedMapPoint(mpt);
 
         // Add mappoint into map
-        Map::getInstance().insertMapPoint(mpt);
+        map_->insertMapPoint(mpt);
     }
 
     void FrontEnd::addKeyframeObservationToOldMapPoints() {
@@ -355,8 +733,21 @@ namespace myslam
 
     void FrontEnd::triangulateActiveMapPoints()
     {
-        int triangulatedCnt = 0;
-        for (auto &mappoint : Map::getInstance().getActiveMappoints())
+        ScopedTimer timer(Profiler::STAGE_TRIANGULATION);
+
+        // observations of the eligible mappoints, the poses of their keyframes
+        // are read once for the whole batch
+        struct Observations
+        {
+            MapPoint::Ptr mapPoint;
+            vector<pair<int, Vec3>> points;   // index in poses, point in normalized plane
+        };
+        vector<Observations> batch;
+        vector<Mat34, Eigen::aligned_allocator<Mat34>> poses;
+        unordered_map<unsigned long, int> poseIndex;   // keyframe id to index in poses, -1 if gone
+
+        auto activeMpts = map_->getActiveMappoints();
+        for (auto &mappoint : *activeMpts)
         {
             auto mp = mappoint.second;
             if ( mp->outlier_ || mp->triangulated_ || mp->optimized_) {
@@ -368,35 +759,62 @@ namespace myslam
                 continue;
             }
 
-            // try to triangulate the mappoint
-            vector<SE3> poses;
-            vector<Vec3> points;
+            Observations obs;
+            obs.mapPoint = mp;
             for (auto &keyFrameMap : mp->getKeyFrameObservationsMap())
             {
-                auto keyFrame = Map::getInstance().getKeyFrame(keyFrameMap.first);
-                auto keyPoint = keyFrameMap.second;
-
-                if ( keyFrame == nullptr ) {
+                auto iter = poseIndex.find(keyFrameMap.first);
+                if (iter == poseIndex.end())
+                {
+                    auto keyFrame = map_->getKeyFrame(keyFrameMap.first);
+                    int idx = -1;
+                    if (keyFrame != nullptr)
+                    {
+                        idx = poses.size();
+                        poses.push_back(keyFrame->getPose().matrix3x4());
+                    }
+                    iter = poseIndex.insert(make_pair(keyFrameMap.first, idx)).first;
+                }
+                if (iter->second < 0) {
                     continue;
-                } 
+                }
+                obs.points.push_back(make_pair(iter->second, frameCurr_->camera_->pixel2camera(keyFrameMap.second)));
+            }
 
-                poses.push_back(keyFrame->getPose());
-                points.push_back(keyFrame->camera_->pixel2camera(keyPoint));
+            if (obs.points.size() >= 2) {
+                batch.push_back(obs);
             }
+        }
 
-            if (poses.size() >= 2) {
-                Vec3 pworld = Vec3::Zero();
-                if (triangulation(poses, points, pworld) && pworld[2] > 0)
+        // try to triangulate all the mappoints in parallel
+        vector<Vec3, Eigen::aligned_allocator<Vec3>> positions(batch.size());
+        vector<uchar> success(batch.size(), 0);
+        parallelFor(0, batch.size(), [&](const cv::Range& range) {
+            for (int i = range.start; i < range.end; i++)
+            {
+                Eigen::Matrix4d AtA = Eigen::Matrix4d::Zero();
+                for (auto &p : batch[i].points)
                 {
-                    // if triangulate successfully
-                    mp->setPosition(pworld);
-                    mp->triangulated_ = true;
-                    triangulatedCnt++;
-                    break;
+                    addTriangulationObservation(poses[p.first], p.second, AtA);
                 }
+                Vec3 pworld = Vec3::Zero();
+                success[i] = triangulationFromNormal(AtA, pworld) && pworld[2] > 0;
+                positions[i] = pworld;
+            }
+        });
+
+        // if triangulate successfully
+        int triangulatedCnt = 0;
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            if (!success[i]) {
+                continue;
             }
+            map_->updateMapPointPosition(batch[i].mapPoint, positions[i]);
+            batch[i].mapPoint->triangulated_ = true;
+            triangulatedCnt++;
         }
-        cout << "  Triangulate active mappoints size: " << triangulatedCnt << endl;
+        cout << "  Triangulate active mappoints size: " << triangulatedCnt << " of " << batch.size() << endl;
     }
 
 } //namespace
\ No newline at end of file
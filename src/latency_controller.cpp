@@ -0,0 +1,67 @@
+#include "myslam/latency_controller.h"
+#include "myslam/config.h"
+
+namespace myslam {
+
+LatencyController::LatencyController()
+: scale_(1.0), smoothedMs_(0), framesSinceChange_(0)
+{
+    deadlineMs_ = Config::get<double>("latency_deadline_ms");
+    smoothing_ = min(1.0, max(0.01, Config::get<double>("latency_smoothing")));
+    lowRatio_ = Config::get<double>("latency_low_ratio");
+    adaptInterval_ = max(1, Config::get<int>("latency_adapt_interval"));
+    minScale_ = min(1.0, max(0.05, Config::get<double>("latency_min_scale")));
+    minInliers_ = cvCeil(Config::get<int>("min_inliers") * Config::get<double>("latency_inlier_margin"));
+    minLevels_ = max(1, Config::get<int>("latency_min_levels"));
+    maxKeyFrameSpacing_ = max(1.0, Config::get<double>("latency_max_keyframe_spacing"));
+
+    base_.numFeatures = Config::get<int>("number_of_features");
+    base_.numLevels = Config::get<int>("level_pyramid");
+    base_.ransacIterations = Config::get<int>("ransac_max_iterations");
+    base_.keyFrameSpacing = 1.0;
+    budget_ = base_;
+}
+
+void LatencyController::setScale(const double scale)
+{
+    scale_ = min(1.0, max(minScale_, scale));
+    budget_.numFeatures = max(1, cvRound(base_.numFeatures * scale_));
+    budget_.numLevels = min(base_.numLevels, max(minLevels_, cvCeil(base_.numLevels * scale_)));
+    budget_.ransacIterations = max(1, cvRound(base_.ransacIterations * scale_));
+    // fewer keyframes, each one costs the mappoint creation and a backend pass
+    budget_.keyFrameSpacing = min(maxKeyFrameSpacing_, 1.0 / scale_);
+}
+
+bool LatencyController::update(const double frameMs, const int inliers)
+{
+    smoothedMs_ = (smoothedMs_ > 0) ? (1 - smoothing_) * smoothedMs_ + smoothing_ * frameMs : frameMs;
+    if (++framesSinceChange_ < adaptInterval_) {
+        return false;
+    }
+
+    double scale = scale_;
+    if (inliers != NO_INLIERS && inliers < minInliers_) {
+        scale = scale_ * 1.2;
+    } else if (smoothedMs_ > deadlineMs_) {
+        // most of the frame time scales with the number of features
+        scale = scale_ * min(0.95, max(0.75, deadlineMs_ / smoothedMs_));
+    } else if (smoothedMs_ < lowRatio_ * deadlineMs_) {
+        scale = scale_ * 1.1;
+    }
+
+    const Budget previous = budget_;
+    setScale(scale);
+    if (budget_.numFeatures == previous.numFeatures && budget_.numLevels == previous.numLevels
+        && budget_.ransacIterations == previous.ransacIterations
+        && budget_.keyFrameSpacing == previous.keyFrameSpacing)
+    {
+        return false;
+    }
+    framesSinceChange_ = 0;
+    cout << "  Latency " << smoothedMs_ << " ms of " << deadlineMs_ << " ms, budget scale " << scale_
+         << ": " << budget_.numFeatures << " features, " << budget_.numLevels << " levels, "
+         << budget_.ransacIterations << " RANSAC iterations" << endl;
+    return true;
+}
+
+} // namespace
@@ -0,0 +1,261 @@
+#include "myslam/local_ba.h"
+#include "myslam/map.h"
+#include "myslam/util.h"
+
+namespace myslam {
+
+LocalBundleAdjustment::LocalBundleAdjustment(const Map::Ptr& map, const Camera::Ptr& camera, const float chi2Th, const bool incremental)
+: map_(map), camera_(camera), chi2Th_(chi2Th), incremental_(incremental), nextVertexId_(1), nextEdgeId_(1)
+{
+    typedef g2o::BlockSolver_6_3 BlockSolverType;
+    typedef g2o::LinearSolverCSparse<BlockSolverType::PoseMatrixType> LinearSolverType;
+    auto solver = new g2o::OptimizationAlgorithmLevenberg(
+        g2o::make_unique<BlockSolverType>(g2o::make_unique<LinearSolverType>()));
+    optimizer_.setAlgorithm(solver);
+}
+
+void LocalBundleAdjustment::clear()
+{
+    // the optimizer owns and deletes the vertices and edges
+    optimizer_.clear();
+    poses_.clear();
+    points_.clear();
+    edges_.clear();
+}
+
+void LocalBundleAdjustment::setWindow(const unordered_set<unsigned long>& windowKeyFrameIds)
+{
+    if (!incremental_) {
+        clear();
+    }
+
+    // Keyframes of the window
+    unordered_map<unsigned long, Frame::Ptr> windowKeyFrames;
+    for (auto& id : windowKeyFrameIds) {
+        auto keyFrame = map_->getKeyFrame(id);
+        if (keyFrame != nullptr) {
+            windowKeyFrames[id] = keyFrame;
+        }
+    }
+
+    // Mappoints observed by the window
+    unordered_map<unsigned long, MapPoint::Ptr> mapPoints;
+    for (auto& kf : windowKeyFrames) {
+        for (auto& mapPointPtr : kf.second->getObservedMapPoints()) {
+            if (mapPointPtr.expired()) {
+                continue;
+            }
+            auto mapPoint = mapPointPtr.lock();
+            if (mapPoint->outlier_) {
+                continue;
+            }
+            mapPoints[mapPoint->getId()] = mapPoint;
+        }
+    }
+
+    // Observations of these mappoints, the keyframes out of the window are fixed
+    unordered_map<unsigned long, Frame::Ptr> fixedKeyFrames;
+    unordered_map<EdgeKey, cv::Point2f, EdgeKeyHash> observations;
+    for (auto& mp : mapPoints) {
+        for (auto& observation : mp.second->getKeyFrameObservationsMap()) {
+            if (!windowKeyFrames.count(observation.first) && !fixedKeyFrames.count(observation.first)) {
+                auto keyFrame = map_->getKeyFrame(observation.first);
+                if (keyFrame == nullptr) {
+                    continue;
+                }
+                fixedKeyFrames[observation.first] = keyFrame;
+            }
+            observations[make_pair(observation.first, mp.first)] = observation.second;
+        }
+    }
+
+    // Remove the edges and then the vertices which left the window
+    for (auto iter = edges_.begin(); iter != edges_.end(); ) {
+        if (!observations.count(iter->first)) {
+            optimizer_.removeEdge(iter->second.edge);
+            iter = edges_.erase(iter);
+        } else {
+            iter++;
+        }
+    }
+    for (auto iter = points_.begin(); iter != points_.end(); ) {
+        if (!mapPoints.count(iter->first)) {
+            if (iter->second.prior) {
+                optimizer_.removeEdge(iter->second.prior);
+            }
+            optimizer_.removeVertex(iter->second.vertex);
+            iter = points_.erase(iter);
+        } else {
+            iter++;
+        }
+    }
+    for (auto iter = poses_.begin(); iter != poses_.end(); ) {
+        if (!windowKeyFrames.count(iter->first) && !fixedKeyFrames.count(iter->first)) {
+            optimizer_.removeVertex(iter->second.vertex);
+            iter = poses_.erase(iter);
+        } else {
+            iter++;
+        }
+    }
+
+    // Add the new vertices, the kept ones start from the current estimate in the map,
+    // which is the last solution unless the frontend moved them meanwhile
+    auto addPose = [&](const Frame::Ptr& keyFrame, const bool fixed) {
+        auto iter = poses_.find(keyFrame->getId());
+        VertexPose* vertex;
+        if (iter == poses_.end()) {
+            vertex = new VertexPose;
+            vertex->setId(nextVertexId_++);
+            vertex->setEstimate(keyFrame->getPose());
+            optimizer_.addVertex(vertex);
+            PoseNode node = {vertex, keyFrame};
+            poses_[keyFrame->getId()] = node;
+        } else {
+            vertex = iter->second.vertex;
+            vertex->setEstimate(keyFrame->getPose());
+        }
+        vertex->setFixed(fixed || keyFrame->getId() == 0);
+    };
+    for (auto& kf : windowKeyFrames) {
+        addPose(kf.second, false);
+    }
+    for (auto& kf : fixedKeyFrames) {
+        addPose(kf.second, true);
+    }
+
+    for (auto& mp : mapPoints) {
+        auto iter = points_.find(mp.first);
+        if (iter == points_.end()) {
+            VertexMappoint* vertex = new VertexMappoint;
+            vertex->setId(nextVertexId_++);
+            vertex->setEstimate(mp.second->getPosition());
+            vertex->setMarginalized(true);
+            optimizer_.addVertex(vertex);
+            PointNode node = {vertex, mp.second, nullptr};
+            iter = points_.insert(make_pair(mp.first, node)).first;
+        } else {
+            iter->second.vertex->setEstimate(mp.second->getPosition());
+        }
+
+        // prior from the keyframes which left the sliding window
+        Vector3d priorPos;
+        Eigen::Matrix3d priorInformation;
+        if (mp.second->getPositionPrior(priorPos, priorInformation)) {
+            PointNode& node = iter->second;
+            if (node.prior == nullptr) {
+                node.prior = new UnaryEdgePointPrior;
+                node.prior->setVertex(0, node.vertex);
+                node.prior->setId(nextEdgeId_++);
+                optimizer_.addEdge(node.prior);
+            }
+            node.prior->setMeasurement(priorPos);
+            node.prior->setInformation(priorInformation);
+        }
+    }
+
+    // Add the new edges, every edge goes back to level 0 with a robust kernel
+    const double deltaRGBD = sqrt(7.815);
+    for (auto& obs : observations) {
+        auto iter = edges_.find(obs.first);
+        ProjectionEdge* edge;
+        if (iter == edges_.end()) {
+            edge = createProjectionEdge(*camera_);
+            edge->setVertex(0, poses_[obs.first.first].vertex);
+            edge->setVertex(1, points_[obs.first.second].vertex);
+            edge->setId(nextEdgeId_++);
+            edge->setMeasurement(toVec2d(obs.second));
+            edge->setInformation(Eigen::Matrix<double, 2, 2>::Identity());
+            optimizer_.addEdge(edge);
+            EdgeNode node = {edge, poses_[obs.first.first].keyFrame, points_[obs.first.second].mapPoint};
+            edges_[obs.first] = node;
+        } else {
+            edge = iter->second.edge;
+            edge->setLevel(0);
+        }
+        auto rk = new g2o::RobustKernelHuber();
+        rk->setDelta(deltaRGBD);
+        edge->setRobustKernel(rk);
+    }
+}
+
+void LocalBundleAdjustment::optimize(vector<Frame::Ptr>& updatedKeyFrames, vector<MapPoint::Ptr>& updatedMapPoints)
+{
+    updatedKeyFrames.clear();
+    updatedMapPoints.clear();
+    if (edges_.empty()) {
+        return;
+    }
+
+    // Do first round optimization
+    optimizer_.initializeOptimization();
+    optimizer_.optimize(5);
+
+    // Exclude the outliers and do second round optimization without robust kernel
+    for (auto& e : edges_) {
+        auto edge = e.second.edge;
+        edge->computeError();
+        if (edge->chi2() > chi2Th_) {
+            edge->setLevel(1);
+        }
+        edge->setRobustKernel(0);
+    }
+
+    optimizer_.initializeOptimization();
+    optimizer_.optimize(10);
+
+    // Remove the outlier observations from the map and from the graph
+    int outlierCnt = 0;
+    for (auto iter = edges_.begin(); iter != edges_.end(); ) {
+        auto edge = iter->second.edge;
+        auto& mapPoint = iter->second.mapPoint;
+        edge->computeError();
+        mapPoint->optimized_ = true;
+        if (edge->chi2() > chi2Th_ || edge->level() == 1) {
+            mapPoint->removeKeyFrameObservation(iter->second.keyFrame->getId());
+            iter->second.keyFrame->removeObservedMapPoint(mapPoint);
+            optimizer_.removeEdge(edge);
+            iter = edges_.erase(iter);
+            outlierCnt++;
+        } else {
+            iter++;
+        }
+    }
+
+    int fixedCnt = 0;
+    for (auto& p : poses_) {
+        if (p.second.vertex->fixed()) {
+            fixedCnt++;
+        }
+    }
+    int priorCnt = 0;
+    for (auto& p : points_) {
+        if (p.second.prior) {
+            priorCnt++;
+        }
+    }
+
+    cout << "\nBackend:" << endl;
+    cout << "  optimized pose number: " << poses_.size() - fixedCnt << endl;
+    cout << "  fixed pose number: " << fixedCnt << endl;
+    cout << "  mappoint number: " << points_.size() << endl;
+    cout << "  edge number: " << edges_.size() + outlierCnt << endl;
+    cout << "  prior number: " << priorCnt << endl;
+    cout << "  outlier observations: " << outlierCnt << endl;
+    cout << endl;
+
+    // Set pose and mappoint position
+    for (auto& p : poses_) {
+        if (!p.second.vertex->fixed()) {
+            p.second.keyFrame->setPose(p.second.vertex->estimate());
+            updatedKeyFrames.push_back(p.second.keyFrame);
+        }
+    }
+    for (auto& p : points_) {
+        if (!p.second.mapPoint->outlier_) {
+            map_->updateMapPointPosition(p.second.mapPoint, p.second.vertex->estimate());
+            updatedMapPoints.push_back(p.second.mapPoint);
+        }
+    }
+}
+
+} // namespace
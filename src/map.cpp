@@ -2,6 +2,8 @@
  * 
  */
 
+#include <algorithm>
+
 #include "myslam/map.h"
 
 namespace myslam
@@ -10,7 +12,97 @@ namespace myslam
 void Map::insertKeyFrame ( const Frame::Ptr& frame )
 {
     unique_lock<mutex> lck(data_mutex_);
+    if (!keyFrames_.count(frame->getId())) {
+        keyFrameIds_.push_back(frame->getId());
+    }
     keyFrames_[ frame->getId() ] = frame;
+    keyFramesSnapshot_.invalidate();
+    nextFrameId_ = max(nextFrameId_, frame->getId() + 1);
+    vector<Frame::Ptr> retired = popOldKeyframes(frame);
+    lck.unlock();
+
+    // the observation mutex of a frame is never taken inside data_mutex_,
+    // the frame may call into the map while it holds it
+    for ( auto& keyFrame : retired ) {
+        const vector<weak_ptr<MapPoint>> observations = keyFrame->getObservedMapPoints();
+        lck.lock();
+        removeOldKeyframe(keyFrame, observations);
+        lck.unlock();
+    }
+}
+
+vector<Frame::Ptr> Map::popOldKeyframes ( const Frame::Ptr& curr_frame )
+{
+    vector<Frame::Ptr> retired;
+    if ( slidingWindowSize_ <= 0 ) {
+        return retired;
+    }
+
+    while ( keyFrameIds_.size() > size_t(slidingWindowSize_) ) {
+        auto iter = keyFrames_.find(keyFrameIds_.front());
+        keyFrameIds_.pop_front();
+        if ( iter != keyFrames_.end() && iter->second != curr_frame ) {
+            retired.push_back(iter->second);
+        }
+    }
+    return retired;
+}
+
+void Map::removeOldKeyframe ( const Frame::Ptr& keyFrame, const vector<weak_ptr<MapPoint>>& observations )
+{
+    auto iter = keyFrames_.find(keyFrame->getId());
+    if ( iter == keyFrames_.end() || iter->second != keyFrame ) {
+        return;
+    }
+    const SE3 T_c_w = keyFrame->getPose();
+    retiredPoses_.push_back(make_pair(keyFrame->time_stamp_, T_c_w));
+
+    for ( auto& mapPointPtr : observations ) {
+        if ( mapPointPtr.expired() ) {
+            continue;
+        }
+        auto mp = mapPointPtr.lock();
+        size_t remaining = mp->retireKeyFrameObservation(keyFrame->getId());
+
+        if ( mp->outlier_ || remaining == 0 ) {
+            // no keyframe of the window observes it any more
+            mapPoints.erase(mp->getId());
+            activeMapPoints_.erase(mp->getId());
+            voxelIndex_->erase(mp->getId());
+            continue;
+        }
+
+        // the retired keyframe is fixed from now on, its reprojection error
+        // only constrains the mappoint: J^T * J of the projection w.r.t. the point
+        Vector3d pos = mp->getPosition();
+        Vector3d p_cam = T_c_w * pos;
+        if ( p_cam[2] <= 0 ) {
+            continue;
+        }
+        Eigen::Matrix<double, 2, 3> J;
+        keyFrame->camera_->projectJacobian(p_cam, J);
+        J = J * T_c_w.rotationMatrix();
+        mp->addPositionPrior(pos, J.transpose() * J);
+    }
+
+    covisibility_->removeKeyFrame(keyFrame->getId());
+
+    keyFrames_.erase(iter);
+    mapPointsSnapshot_.invalidate();
+    activeSnapshot_.invalidate();
+}
+
+Map::Trajectory Map::getTrajectory ()
+{
+    unique_lock<mutex> lck(data_mutex_);
+    Trajectory trajectory = retiredPoses_;
+    for ( auto& id : keyFrameIds_ ) {
+        auto iter = keyFrames_.find(id);
+        if ( iter != keyFrames_.end() ) {
+            trajectory.push_back(make_pair(iter->second->time_stamp_, iter->second->getPose()));
+        }
+    }
+    return trajectory;
 }
 
 void Map::insertMapPoint ( const MapPoint::Ptr& map_point )
@@ -18,26 +110,80 @@ void Map::insertMapPoint ( const MapPoint::Ptr& map_point )
     unique_lock<mutex> lck(data_mutex_);
     mapPoints[map_point->getId()] = map_point;
     activeMapPoints_[map_point->getId()] = map_point;
+    // restored mappoints come with their own id, the new ones must not reuse it
+    if ( map_point->getId() >= nextMapPointId_ ) {
+        nextMapPointId_ = map_point->getId() + 1;
+    }
+    mapPointsSnapshot_.invalidate();
+    activeSnapshot_.invalidate();
+    voxelIndex_->insert(map_point, map_point->getPosition());
 }
 
-void Map::cullNonActiveMapPoints( const Frame::Ptr& currFrame ) {
+void Map::updateMapPointPosition ( const MapPoint::Ptr& map_point, const Vector3d& pos )
+{
     unique_lock<mutex> lck(data_mutex_);
+    map_point->setPosition(pos);
+    voxelIndex_->update(map_point, pos);
+}
 
-    // remove the hardly seen and no visible points from active mappoints
-    list<unsigned long> remove_id;
-    for (auto& mappoint : activeMapPoints_) {
-        auto mp_id = mappoint.first;
-        auto mp = mappoint.second;
+void Map::fillProjectionBatch ( const vector<MapPoint::Ptr>& mapPoints )
+{
+    projectionBatch_.clear();
+    for (auto& mp : mapPoints) {
+        projectionBatch_.add(mp->getPosition(), mp->norm_);
+    }
+}
 
-        // if outlider decided by backend
-        if ( mp->outlier_ ) {
-            remove_id.push_back(mp_id);
-            continue;
+vector<MapPoint::Ptr> Map::getMappointsInView ( const Frame::Ptr& frame, const bool activeOnly )
+{
+    unique_lock<mutex> lck(data_mutex_);
+
+    vector<MapPoint::Ptr> candidates;
+    voxelIndex_->queryFrustum(frame, candidates);
+
+    if ( activeOnly ) {
+        auto last = std::remove_if(candidates.begin(), candidates.end(), [this](const MapPoint::Ptr& mp) {
+            return !activeMapPoints_.count(mp->getId());
+        });
+        candidates.erase(last, candidates.end());
+    }
+
+    fillProjectionBatch(candidates);
+    frame->projectBatch(projectionBatch_);
+
+    vector<MapPoint::Ptr> inView;
+    for (size_t i = 0; i < candidates.size(); i++) {
+        if ( projectionBatch_.visible[i] ) {
+            inView.push_back(candidates[i]);
         }
+    }
+    return inView;
+}
+
+void Map::cullNonActiveMapPoints( const Frame::Ptr& currFrame ) {
+    unique_lock<mutex> lck(data_mutex_);
+
+    // only the active mappoints around the current view can stay active,
+    // the others are not visible and are dropped without being visited
+    vector<MapPoint::Ptr> candidates;
+    voxelIndex_->queryFrustum(currFrame, candidates);
+
+    // the outliders decided by backend and the non-active ones are skipped before the projection
+    auto last = std::remove_if(candidates.begin(), candidates.end(), [this](const MapPoint::Ptr& mp) {
+        return mp->outlier_ || !activeMapPoints_.count(mp->getId());
+    });
+    candidates.erase(last, candidates.end());
+
+    fillProjectionBatch(candidates);
+    currFrame->projectBatch(projectionBatch_);
+
+    const float minCosAngle = cos(M_PI/6.);
+    MappointDict stillActive;
+    for (size_t i = 0; i < candidates.size(); i++) {
+        auto& mp = candidates[i];
 
         // if not in current view
-        if ( !currFrame->isInFrame(mp->getPosition()) ) {
-            remove_id.push_back(mp_id);
+        if ( !projectionBatch_.visible[i] ) {
             continue;
         }
 
@@ -45,24 +191,20 @@ void Map::cullNonActiveMapPoints( const Frame::Ptr& currFrame ) {
         float match_ratio = float(mp->matchedTimes_) / mp->visibleTimes_;
         if ( match_ratio < mapPointEraseRatio_ )
         {
-            remove_id.push_back(mp_id);
             continue;
         }
 
         // not in good view
-        Vector3d direction = mp->getPosition() - currFrame->getCamCenter();
-        direction.normalize();
-        double angle = acos( direction.transpose() * mp->norm_ );
-        if ( angle > M_PI/6. )
+        if ( projectionBatch_.cosAngle[i] < minCosAngle )
         {
-            remove_id.push_back(mp_id);
             continue;
         }
-    }
 
-    for(auto& id : remove_id) {
-        activeMapPoints_.erase(id);
+        stillActive[mp->getId()] = mp;
     }
+
+    activeMapPoints_.swap(stillActive);
+    activeSnapshot_.invalidate();
 }
 
 inline double getViewAngle ( const Frame::Ptr& frame, const MapPoint::Ptr& point )
@@ -0,0 +1,283 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include "myslam/map_io.h"
+#include "myslam/map.h"
+
+namespace myslam {
+
+namespace {
+
+const char MAGIC[8] = {'M', 'Y', 'S', 'L', 'A', 'M', 'A', 'P'};
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+const uint64_t SECTION_ALIGNMENT = 32;
+
+uint64_t alignSection(const uint64_t offset)
+{
+    return (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+}
+
+// pad the stream up to offset, then write size bytes
+void writeSection(ofstream& out, const uint64_t offset, const void* data, const size_t size)
+{
+    static const char zeros[SECTION_ALIGNMENT] = {0};
+    uint64_t pos = out.tellp();
+    while (pos < offset) {
+        size_t n = min<uint64_t>(offset - pos, SECTION_ALIGNMENT);
+        out.write(zeros, n);
+        pos += n;
+    }
+    if (size > 0) {
+        out.write(static_cast<const char*>(data), size);
+    }
+}
+
+// true if count records of size recordSize at offset are inside the file and aligned
+bool checkSection(const MappedFile& file, const uint64_t offset, const uint64_t count, const uint64_t recordSize)
+{
+    if (offset % SECTION_ALIGNMENT != 0 || offset > file.size()) {
+        return false;
+    }
+    return count <= (file.size() - offset) / recordSize;
+}
+
+} // namespace
+
+MappedFile::Ptr MappedFile::open(const string& path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return nullptr;
+    }
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping stays valid after the descriptor is closed
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        return nullptr;
+    }
+    return MappedFile::Ptr(new MappedFile(static_cast<const uchar*>(data), st.st_size));
+}
+
+MappedFile::~MappedFile()
+{
+    munmap(const_cast<uchar*>(data_), size_);
+}
+
+bool MapIO::save(const string& path, const Map::Ptr& map)
+{
+    auto keyFrames = map->getAllKeyFrames();
+    auto mapPoints = map->getAllMappoints();
+
+    // sorted by id, the same map always gives the same file
+    vector<Frame::Ptr> sortedKeyFrames;
+    Camera::Ptr camera;
+    for (auto& kf : *keyFrames) {
+        sortedKeyFrames.push_back(kf.second);
+        camera = kf.second->camera_;
+    }
+    sort(sortedKeyFrames.begin(), sortedKeyFrames.end(),
+         [](const Frame::Ptr& a, const Frame::Ptr& b) { return a->getId() < b->getId(); });
+
+    vector<MapPoint::Ptr> sortedMapPoints;
+    for (auto& mp : *mapPoints) {
+        if (!mp.second->outlier_) {
+            sortedMapPoints.push_back(mp.second);
+        }
+    }
+    sort(sortedMapPoints.begin(), sortedMapPoints.end(),
+         [](const MapPoint::Ptr& a, const MapPoint::Ptr& b) { return a->getId() < b->getId(); });
+
+    vector<KeyFrameRecord> keyFrameRecords;
+    for (auto& kf : sortedKeyFrames) {
+        const SE3 T_c_w = kf->getPose();
+        const Eigen::Quaterniond q = T_c_w.unit_quaternion();
+        KeyFrameRecord record;
+        record.id = kf->getId();
+        record.timeStamp = kf->time_stamp_;
+        for (int i = 0; i < 3; i++) {
+            record.translation[i] = T_c_w.translation()[i];
+        }
+        record.rotation[0] = q.x();
+        record.rotation[1] = q.y();
+        record.rotation[2] = q.z();
+        record.rotation[3] = q.w();
+        keyFrameRecords.push_back(record);
+    }
+
+    // only the observations of the saved keyframes, the mappoints without any are dropped
+    vector<MapPointRecord> mapPointRecords;
+    vector<ObservationRecord> observationRecords;
+    vector<uchar> descriptors;
+    for (auto& mp : sortedMapPoints) {
+        MapPointRecord record;
+        record.id = mp->getId();
+        record.firstObservation = observationRecords.size();
+        for (auto& obs : mp->getKeyFrameObservationsMap()) {
+            if (!keyFrames->count(obs.first)) {
+                continue;
+            }
+            ObservationRecord observation = {obs.first, obs.second.x, obs.second.y};
+            observationRecords.push_back(observation);
+        }
+        record.numObservations = observationRecords.size() - record.firstObservation;
+        if (record.numObservations == 0) {
+            continue;
+        }
+
+        const Vector3d pos = mp->getPosition();
+        for (int i = 0; i < 3; i++) {
+            record.position[i] = pos[i];
+            record.norm[i] = mp->norm_[i];
+        }
+        mapPointRecords.push_back(record);
+        descriptors.insert(descriptors.end(), mp->descriptor_, mp->descriptor_ + DescriptorPool::DESCRIPTOR_SIZE);
+    }
+
+    MapFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.byteOrder = BYTE_ORDER_MARK;
+    if (camera) {
+        header.fx = camera->fx_;
+        header.fy = camera->fy_;
+        header.cx = camera->cx_;
+        header.cy = camera->cy_;
+        header.k1 = camera->k1_;
+        header.k2 = camera->k2_;
+        header.p1 = camera->p1_;
+        header.p2 = camera->p2_;
+    }
+    header.numKeyFrames = keyFrameRecords.size();
+    header.numMapPoints = mapPointRecords.size();
+    header.numObservations = observationRecords.size();
+    header.keyFramesOffset = alignSection(sizeof(MapFileHeader));
+    header.mapPointsOffset = alignSection(header.keyFramesOffset + keyFrameRecords.size() * sizeof(KeyFrameRecord));
+    header.descriptorsOffset = alignSection(header.mapPointsOffset + mapPointRecords.size() * sizeof(MapPointRecord));
+    header.observationsOffset = alignSection(header.descriptorsOffset + descriptors.size());
+    header.fileSize = header.observationsOffset + observationRecords.size() * sizeof(ObservationRecord);
+
+    ofstream out(path, ios::binary | ios::trunc);
+    if (!out) {
+        cout << "Cannot open the map file " << path << endl;
+        return false;
+    }
+    writeSection(out, 0, &header, sizeof(header));
+    writeSection(out, header.keyFramesOffset, keyFrameRecords.data(), keyFrameRecords.size() * sizeof(KeyFrameRecord));
+    writeSection(out, header.mapPointsOffset, mapPointRecords.data(), mapPointRecords.size() * sizeof(MapPointRecord));
+    writeSection(out, header.descriptorsOffset, descriptors.data(), descriptors.size());
+    writeSection(out, header.observationsOffset, observationRecords.data(), observationRecords.size() * sizeof(ObservationRecord));
+    out.close();
+    if (!out) {
+        cout << "Failed to write the map file " << path << endl;
+        return false;
+    }
+
+    cout << "Saved map " << path << ": " << header.numKeyFrames << " keyframes, "
+         << header.numMapPoints << " mappoints, " << header.numObservations << " observations" << endl;
+    return true;
+}
+
+bool MapIO::load(const string& path, const Camera::Ptr& camera, const Map::Ptr& map)
+{
+    if (!map->getAllKeyFrames()->empty() || !map->getAllMappoints()->empty()) {
+        cout << "The map must be empty to load " << path << endl;
+        return false;
+    }
+
+    MappedFile::Ptr file = MappedFile::open(path);
+    if (file == nullptr) {
+        cout << "Cannot map the map file " << path << endl;
+        return false;
+    }
+
+    // validate the header and the bounds of all the sections before touching them
+    if (file->size() < sizeof(MapFileHeader)) {
+        cout << "Truncated map file " << path << endl;
+        return false;
+    }
+    const MapFileHeader& header = *reinterpret_cast<const MapFileHeader*>(file->data());
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.byteOrder != BYTE_ORDER_MARK) {
+        cout << "Not a map file of this platform: " << path << endl;
+        return false;
+    }
+    if (header.version != VERSION) {
+        cout << "Unsupported map file version " << header.version << ": " << path << endl;
+        return false;
+    }
+    if (header.fileSize != file->size()
+        || !checkSection(*file, header.keyFramesOffset, header.numKeyFrames, sizeof(KeyFrameRecord))
+        || !checkSection(*file, header.mapPointsOffset, header.numMapPoints, sizeof(MapPointRecord))
+        || !checkSection(*file, header.descriptorsOffset, header.numMapPoints, DescriptorPool::DESCRIPTOR_SIZE)
+        || !checkSection(*file, header.observationsOffset, header.numObservations, sizeof(ObservationRecord))) {
+        cout << "Corrupted map file " << path << endl;
+        return false;
+    }
+    if (header.fx != camera->fx_ || header.fy != camera->fy_ || header.cx != camera->cx_ || header.cy != camera->cy_
+        || header.k1 != camera->k1_ || header.k2 != camera->k2_ || header.p1 != camera->p1_ || header.p2 != camera->p2_) {
+        cout << "Warning: the map file was built with another camera" << endl;
+    }
+
+    const KeyFrameRecord* keyFrameRecords = reinterpret_cast<const KeyFrameRecord*>(file->data() + header.keyFramesOffset);
+    const MapPointRecord* mapPointRecords = reinterpret_cast<const MapPointRecord*>(file->data() + header.mapPointsOffset);
+    const uchar* descriptors = file->data() + header.descriptorsOffset;
+    const ObservationRecord* observationRecords = reinterpret_cast<const ObservationRecord*>(file->data() + header.observationsOffset);
+
+    for (uint64_t i = 0; i < header.numKeyFrames; i++) {
+        const KeyFrameRecord& record = keyFrameRecords[i];
+        const Eigen::Quaterniond q(record.rotation[3], record.rotation[0], record.rotation[1], record.rotation[2]);
+        const Vector3d t(record.translation[0], record.translation[1], record.translation[2]);
+        map->insertKeyFrame(Frame::restoreKeyFrame(record.id, record.timeStamp, SE3(q.normalized(), t), camera));
+    }
+
+    // the descriptors stay in the file, which lives as long as the pool
+    DescriptorPool::Ptr descriptorPool = map->getDescriptorPool();
+    descriptorPool->attach(descriptors, header.numMapPoints, file);
+
+    uint64_t observationCnt = 0;
+    for (uint64_t i = 0; i < header.numMapPoints; i++) {
+        const MapPointRecord& record = mapPointRecords[i];
+        MapPoint::Ptr mp = MapPoint::restoreMapPoint(
+            record.id,
+            Vector3d(record.position[0], record.position[1], record.position[2]),
+            Vector3d(record.norm[0], record.norm[1], record.norm[2]),
+            descriptors + i * DescriptorPool::DESCRIPTOR_SIZE,
+            descriptorPool,
+            map->getCovisibilityGraph());
+
+        if (record.firstObservation > header.numObservations
+            || record.numObservations > header.numObservations - record.firstObservation) {
+            continue;
+        }
+        for (uint64_t j = 0; j < record.numObservations; j++) {
+            const ObservationRecord& obs = observationRecords[record.firstObservation + j];
+            // the keyframe may have left the sliding window while loading
+            auto keyFrame = map->getKeyFrame(obs.keyFrameId);
+            if (keyFrame == nullptr) {
+                continue;
+            }
+            mp->addKeyFrameObservation(obs.keyFrameId, cv::Point2f(obs.u, obs.v));
+            keyFrame->addObservedMapPoint(mp);
+            observationCnt++;
+        }
+        if (!mp->getKeyFrameObservationsMap().empty()) {
+            map->insertMapPoint(mp);
+        }
+    }
+
+    cout << "Loaded map " << path << ": " << map->getAllKeyFrames()->size() << " keyframes, "
+         << map->getAllMappoints()->size() << " mappoints, " << observationCnt << " observations" << endl;
+    return true;
+}
+
+} // namespace
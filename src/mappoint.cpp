@@ -1,34 +1,74 @@
 #include "myslam/common_include.h"
+#include <Eigen/Cholesky>
 #include "myslam/mappoint.h"
 
 namespace myslam
 {
 
 MapPoint::MapPoint ( 
+    const FactoryTag&,
     long unsigned int id, 
     const Vector3d& position, 
     const Vector3d& norm, 
     const Mat& descriptor,
     const unsigned long observedKeyFrameId,
-    const cv::Point2f& pixelPos)
-: id_(id), pos_(position), norm_(norm), triangulated_(false), visibleTimes_(1), matchedTimes_(1), descriptor_(descriptor), outlier_(false), optimized_(false)
+    const cv::Point2f& pixelPos,
+    const DescriptorPool::Ptr& descriptorPool,
+    const CovisibilityGraph::Ptr& covisibility)
+: id_(id), pos_(position), norm_(norm), triangulated_(false), visibleTimes_(1), matchedTimes_(1), outlier_(false), optimized_(false),
+  descriptorPool_(descriptorPool), covisibility_(covisibility), hasPrior_(false)
 {
+    // copy the descriptor into the pool instead of keeping its own Mat
+    descriptor_ = descriptorPool_->allocate(descriptor.ptr<uchar>(0));
     addKeyFrameObservation(observedKeyFrameId, pixelPos);
 }
 
+MapPoint::MapPoint (
+    const FactoryTag&,
+    long unsigned int id,
+    const Vector3d& position,
+    const Vector3d& norm,
+    const uchar* pooledDescriptor,
+    const DescriptorPool::Ptr& descriptorPool,
+    const CovisibilityGraph::Ptr& covisibility)
+: id_(id), pos_(position), norm_(norm), triangulated_(false), visibleTimes_(1), matchedTimes_(1), outlier_(false), optimized_(false),
+  descriptor_(pooledDescriptor), descriptorPool_(descriptorPool), covisibility_(covisibility), hasPrior_(false)
+{
+}
+
+MapPoint::~MapPoint()
+{
+    descriptorPool_->release(descriptor_);
+}
+
 MapPoint::Ptr MapPoint::createMapPoint ( 
+    const unsigned long id,
     const Vector3d posWorld, 
     const Vector3d norm,
     const Mat descriptor,
     const unsigned long observedKeyFrameId,
-    const cv::Point2f pixelPos)
+    const cv::Point2f pixelPos,
+    const DescriptorPool::Ptr& descriptorPool,
+    const CovisibilityGraph::Ptr& covisibility)
 {
-    return MapPoint::Ptr( 
-        new MapPoint( factoryId_++, posWorld, norm, descriptor, observedKeyFrameId, pixelPos)
+    // the mappoint and its control block come from the pool as one block
+    return allocate_shared<MapPoint>( PoolAllocator<MapPoint>(),
+        FactoryTag(), id, posWorld, norm, descriptor, observedKeyFrameId, pixelPos, descriptorPool, covisibility
     );
 }
 
-unsigned long MapPoint::factoryId_ = 0;
+MapPoint::Ptr MapPoint::restoreMapPoint (
+    const unsigned long id,
+    const Vector3d& posWorld,
+    const Vector3d& norm,
+    const uchar* descriptor,
+    const DescriptorPool::Ptr& descriptorPool,
+    const CovisibilityGraph::Ptr& covisibility)
+{
+    return allocate_shared<MapPoint>( PoolAllocator<MapPoint>(),
+        FactoryTag(), id, posWorld, norm, descriptor, descriptorPool, covisibility
+    );
+}
 
 
 void MapPoint::removeKeyFrameObservation(const unsigned long keyFrameId) {
@@ -36,6 +76,7 @@ void MapPoint::removeKeyFrameObservation(const unsigned long keyFrameId) {
     for (auto iter = observedKeyFrameMap_.begin(); iter != observedKeyFrameMap_.end(); iter++) {
         if (iter->first == keyFrameId) {
             observedKeyFrameMap_.erase(iter);
+            covisibility_->removeObservation(keyFrameId, id_);
             break;
         }
     }
@@ -47,5 +88,41 @@ void MapPoint::removeKeyFrameObservation(const unsigned long keyFrameId) {
     }
 }
 
+size_t MapPoint::retireKeyFrameObservation(const unsigned long keyFrameId) {
+    unique_lock<mutex> lck(observationMutex_);
+    for (auto iter = observedKeyFrameMap_.begin(); iter != observedKeyFrameMap_.end(); iter++) {
+        if (iter->first == keyFrameId) {
+            observedKeyFrameMap_.erase(iter);
+            covisibility_->removeObservation(keyFrameId, id_);
+            break;
+        }
+    }
+    return observedKeyFrameMap_.size();
+}
+
+void MapPoint::addPositionPrior(const Vector3d& pos, const Eigen::Matrix3d& information) {
+    unique_lock<mutex> lck(observationMutex_);
+    if (!hasPrior_) {
+        priorPos_ = pos;
+        priorInformation_ = information;
+        hasPrior_ = true;
+        return;
+    }
+
+    // product of the two gaussians
+    Eigen::Matrix3d fused = priorInformation_ + information;
+    priorPos_ = fused.ldlt().solve(priorInformation_ * priorPos_ + information * pos);
+    priorInformation_ = fused;
+}
+
+bool MapPoint::getPositionPrior(Vector3d& pos, Eigen::Matrix3d& information) {
+    unique_lock<mutex> lck(observationMutex_);
+    if (!hasPrior_) {
+        return false;
+    }
+    pos = priorPos_;
+    information = priorInformation_;
+    return true;
+}
 
 } // namespace
\ No newline at end of file
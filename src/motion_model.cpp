@@ -0,0 +1,28 @@
+#include "myslam/motion_model.h"
+
+namespace myslam {
+
+void MotionModel::update(const double timeStamp, const SE3& T_c_w)
+{
+    if (hasPose_) {
+        // T_c_w = exp(velocity * dt) * lastPose_
+        velocity_ = (T_c_w * lastPose_.inverse()).log() / elapsed(lastTime_, timeStamp);
+        hasVelocity_ = true;
+    }
+    lastPose_ = T_c_w;
+    lastTime_ = timeStamp;
+    hasPose_ = true;
+}
+
+bool MotionModel::predict(const double timeStamp, SE3& T_c_w) const
+{
+    if (!hasVelocity_) {
+        T_c_w = lastPose_;
+        return false;
+    }
+    Sophus::Vector6d delta = velocity_ * elapsed(lastTime_, timeStamp);
+    T_c_w = SE3::exp(delta) * lastPose_;
+    return true;
+}
+
+} // namespace
@@ -0,0 +1,112 @@
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/video/tracking.hpp>
+
+#include "myslam/optical_flow_tracker.h"
+#include "myslam/config.h"
+
+namespace myslam {
+
+OpticalFlowTracker::OpticalFlowTracker()
+{
+    levels_ = max(1, Config::get<int>("flow_pyramid_levels"));
+    windowSize_ = Config::get<int>("flow_window_size");
+    iterations_ = Config::get<int>("flow_iterations");
+}
+
+void OpticalFlowTracker::buildPyramid(const Frame::Ptr& frame, vector<Mat>& pyramid) const
+{
+    Mat gray = frame->color_;
+    if (gray.channels() == 3) {
+        cv::cvtColor(frame->color_, gray, cv::COLOR_BGR2GRAY);
+    }
+    // with the derivatives, the pyramid can serve as the reference later
+    cv::buildOpticalFlowPyramid(gray, pyramid, cv::Size(windowSize_, windowSize_), levels_ - 1);
+}
+
+void OpticalFlowTracker::setReference(const Frame::Ptr& keyFrame)
+{
+    if (keyFrame == lastFrame_) {
+        referencePyramid_.swap(lastPyramid_);
+    } else {
+        buildPyramid(keyFrame, referencePyramid_);
+    }
+    lastFrame_ = nullptr;
+    lastPyramid_.clear();
+    reference_ = keyFrame;
+
+    mapPoints_.clear();
+    referencePixels_.clear();
+    for (auto& mappoint : keyFrame->getObservedMapPoints()) {
+        auto mp = mappoint.lock();
+        if (mp == nullptr || mp->outlier_) {
+            continue;
+        }
+        // the pixel of the keyframe observation, the frames only matched in PnP have none
+        for (auto& obs : mp->getKeyFrameObservationsMap()) {
+            if (obs.first == keyFrame->getId()) {
+                mapPoints_.push_back(mp);
+                referencePixels_.push_back(obs.second);
+                break;
+            }
+        }
+    }
+    cout << "  Optical flow reference " << keyFrame->getId() << ": " << mapPoints_.size() << " keypoints" << endl;
+}
+
+int OpticalFlowTracker::track(const Frame::Ptr& frame, PoseCorrespondences& corr)
+{
+    corr.clear();
+    if (reference_ == nullptr) {
+        return 0;
+    }
+
+    vector<Mat> pyramid;
+    pyramid.swap(lastPyramid_);
+    buildPyramid(frame, pyramid);
+
+    // start the search at the projection with the initial pose,
+    // the mappoints out of view are not searched
+    const SE3 T_c_w = frame->getPose();
+    const Camera::Ptr& camera = frame->camera_;
+    const float width = frame->color_.cols, height = frame->color_.rows;
+    trackedFrom_.clear();
+    trackedTo_.clear();
+    trackedIndex_.clear();
+    for (size_t i = 0; i < mapPoints_.size(); i++) {
+        if (mapPoints_[i]->outlier_) {
+            continue;
+        }
+        const Vector3d p_c = camera->world2camera(mapPoints_[i]->getPosition(), T_c_w);
+        if (p_c[2] <= 0) {
+            continue;
+        }
+        const Vector2d pixel = camera->camera2pixel(p_c);
+        if (pixel[0] < 0 || pixel[1] < 0 || pixel[0] >= width || pixel[1] >= height) {
+            continue;
+        }
+        trackedFrom_.push_back(referencePixels_[i]);
+        trackedTo_.push_back(cv::Point2f(pixel[0], pixel[1]));
+        trackedIndex_.push_back(i);
+    }
+
+    if (!trackedFrom_.empty()) {
+        cv::calcOpticalFlowPyrLK(referencePyramid_, pyramid, trackedFrom_, trackedTo_, status_, error_,
+                                 cv::Size(windowSize_, windowSize_), levels_ - 1,
+                                 cv::TermCriteria(cv::TermCriteria::COUNT | cv::TermCriteria::EPS, iterations_, 0.01),
+                                 cv::OPTFLOW_USE_INITIAL_FLOW);
+    }
+
+    for (size_t k = 0; k < trackedFrom_.size(); k++) {
+        const cv::Point2f& pt = trackedTo_[k];
+        if (!status_[k] || pt.x < 0 || pt.y < 0 || pt.x >= width || pt.y >= height) {
+            continue;
+        }
+        corr.add(mapPoints_[trackedIndex_[k]]->getPosition(), pt);
+    }
+
+    lastFrame_ = frame;
+    lastPyramid_.swap(pyramid);
+    return corr.size();
+}
+
+} // namespace
@@ -0,0 +1,116 @@
+#include <iomanip>
+
+#include "myslam/output_sink.h"
+
+namespace myslam {
+
+OutputSink::OutputSink(const string& path)
+: out_(path), running_(true)
+{
+    if (!out_.is_open()) {
+        cout << "Cannot open the stream output file " << path << endl;
+    }
+    out_ << "# streamed output format" << endl;
+    out_ << "# poses are T_c_w as in the trajectory file" << endl;
+    out_ << "# F timestamp frame_id tx ty tz qx qy qz qw" << endl;
+    out_ << "# K timestamp keyframe_id tx ty tz qx qy qz qw" << endl;
+    out_ << "# P mappoint_id x y z" << endl;
+    out_ << "# B keyframe_id" << endl;
+    writerThread_ = std::thread(std::bind(&OutputSink::writerLoop, this));
+}
+
+void OutputSink::Stop()
+{
+    {
+        unique_lock<mutex> lock(queueMutex_);
+        if (!running_) {
+            return;
+        }
+        running_ = false;
+    }
+    queueUpdate_.notify_one();
+    writerThread_.join();
+    out_.close();
+}
+
+void OutputSink::push(Records& records)
+{
+    {
+        unique_lock<mutex> lock(queueMutex_);
+        if (!running_) {
+            return;
+        }
+        queue_.insert(queue_.end(), records.begin(), records.end());
+    }
+    queueUpdate_.notify_one();
+}
+
+void OutputSink::writeFramePose(const Frame::Ptr& frame)
+{
+    Records records(1);
+    records[0].type = 'F';
+    records[0].id = frame->getId();
+    records[0].timeStamp = frame->time_stamp_;
+    records[0].pose = frame->getPose();
+    push(records);
+}
+
+void OutputSink::writeBackendPass(const unsigned long lastKeyFrameId,
+                                  const vector<Frame::Ptr>& keyFrames,
+                                  const vector<MapPoint::Ptr>& mapPoints)
+{
+    Records records(keyFrames.size() + mapPoints.size() + 1);
+    size_t i = 0;
+    for (auto& kf : keyFrames) {
+        records[i].type = 'K';
+        records[i].id = kf->getId();
+        records[i].timeStamp = kf->time_stamp_;
+        records[i].pose = kf->getPose();
+        i++;
+    }
+    for (auto& mp : mapPoints) {
+        records[i].type = 'P';
+        records[i].id = mp->getId();
+        records[i].position = mp->getPosition();
+        i++;
+    }
+    records[i].type = 'B';
+    records[i].id = lastKeyFrameId;
+    push(records);
+}
+
+void OutputSink::writerLoop()
+{
+    out_ << std::setprecision(9);
+    Records records;
+    while (true) {
+        {
+            unique_lock<mutex> lock(queueMutex_);
+            queueUpdate_.wait(lock, [this] { return !queue_.empty() || !running_; });
+            if (queue_.empty()) {
+                return;
+            }
+            records.swap(queue_);
+        }
+
+        for (auto& record : records) {
+            if (record.type == 'P') {
+                out_ << "P " << record.id << ' ' << record.position[0] << ' '
+                     << record.position[1] << ' ' << record.position[2] << '\n';
+            } else if (record.type == 'B') {
+                out_ << "B " << record.id << '\n';
+            } else {
+                // same convention as the trajectory file
+                const Vector3d t = record.pose.translation();
+                const Eigen::Quaterniond q = record.pose.unit_quaternion();
+                out_ << record.type << ' ' << std::to_string(record.timeStamp) << ' '
+                     << record.id << ' ' << t[0] << ' ' << t[1] << ' ' << t[2] << ' '
+                     << q.x() << ' ' << q.y() << ' ' << q.z() << ' ' << q.w() << '\n';
+            }
+        }
+        out_.flush();
+        records.clear();
+    }
+}
+
+} // namespace
@@ -0,0 +1,161 @@
+#include <opencv2/calib3d/calib3d.hpp>
+
+#include "myslam/pnp_ransac.h"
+#include "myslam/config.h"
+#include "myslam/util.h"
+
+namespace myslam {
+
+PnPRansac::PnPRansac()
+{
+    maxIterations_ = Config::get<int>("ransac_max_iterations");
+    batchSize_ = max(1, Config::get<int>("ransac_batch_size"));
+    const double threshold = Config::get<double>("ransac_threshold");
+    threshold2_ = threshold * threshold;
+    confidence_ = Config::get<double>("ransac_confidence");
+    priorInlierRatio_ = Config::get<double>("ransac_prior_inlier_ratio");
+}
+
+template<class Model>
+int PnPRansac::countInliers(const PoseCorrespondences& corr, const Model& model, const SE3& pose) const
+{
+    const Eigen::Matrix3d R = pose.rotationMatrix();
+    const Vector3d t = pose.translation();
+    int cnt = 0;
+    for (size_t i = 0; i < corr.size(); i++) {
+        Vector3d pc = R * Vector3d(corr.x[i], corr.y[i], corr.z[i]) + t;
+        if (pc[2] <= 0) {
+            continue;
+        }
+        cnt += (Vector2d(corr.u[i], corr.v[i]) - model.project(pc)).squaredNorm() < threshold2_;
+    }
+    return cnt;
+}
+
+bool PnPRansac::solveMinimal(const PoseCorrespondences& corr, const Mat& K, const Mat& distCoeffs,
+                             const int* sample, SE3& pose) const
+{
+    vector<cv::Point3f> pts3d(4);
+    vector<cv::Point2f> pts2d(4);
+    for (int i = 0; i < 4; i++) {
+        pts3d[i] = cv::Point3f(corr.x[sample[i]], corr.y[sample[i]], corr.z[sample[i]]);
+        pts2d[i] = cv::Point2f(corr.u[sample[i]], corr.v[sample[i]]);
+    }
+
+    Mat rvec, tvec;
+    if (!cv::solvePnP(pts3d, pts2d, K, distCoeffs, rvec, tvec, false, cv::SOLVEPNP_P3P)) {
+        return false;
+    }
+
+    Mat R;
+    cv::Rodrigues(rvec, R);
+    Eigen::Matrix3d R_eigen;
+    R_eigen << R.at<double>(0, 0), R.at<double>(0, 1), R.at<double>(0, 2),
+        R.at<double>(1, 0), R.at<double>(1, 1), R.at<double>(1, 2),
+        R.at<double>(2, 0), R.at<double>(2, 1), R.at<double>(2, 2);
+    Vector3d t(tvec.at<double>(0, 0), tvec.at<double>(1, 0), tvec.at<double>(2, 0));
+    if (!R_eigen.allFinite() || !t.allFinite()) {
+        return false;
+    }
+    pose = SE3(R_eigen, t);
+    return true;
+}
+
+int PnPRansac::requiredIterations(const double inlierRatio) const
+{
+    if (inlierRatio <= 0) {
+        return maxIterations_;
+    }
+    const double w4 = pow(inlierRatio, 4);
+    if (w4 >= 1 - 1e-12) {
+        return 0;
+    }
+    const double n = log(1 - confidence_) / log(1 - w4);
+    return (n < maxIterations_) ? static_cast<int>(ceil(n)) : maxIterations_;
+}
+
+int PnPRansac::estimate(const PoseCorrespondences& corr, const Camera::Ptr& camera, const SE3& priorPose,
+                        SE3& pose, vector<uchar>& inliers)
+{
+    if (camera->hasDistortion()) {
+        return estimateWith(corr, camera->getRadialTangential(), camera->getCameraMatrix(),
+                            camera->getDistortionCoeffs(), priorPose, pose, inliers);
+    }
+    return estimateWith(corr, camera->getPinhole(), camera->getCameraMatrix(), Mat(), priorPose, pose, inliers);
+}
+
+template<class Model>
+int PnPRansac::estimateWith(const PoseCorrespondences& corr, const Model& model, const Mat& K, const Mat& distCoeffs,
+                            const SE3& priorPose, SE3& pose, vector<uchar>& inliers)
+{
+    const int n = corr.size();
+    inliers.assign(n, 0);
+    if (n < 4) {
+        return 0;
+    }
+
+    // the prior is the first hypothesis
+    pose = priorPose;
+    int bestCnt = countInliers(corr, model, priorPose);
+    int iterations = (bestCnt >= priorInlierRatio_ * n) ? 0 : requiredIterations(double(bestCnt) / n);
+    int sampled = 0;
+
+    vector<SE3, Eigen::aligned_allocator<SE3>> hypotheses(batchSize_);
+    vector<int> inlierCnts(batchSize_);
+    while (sampled < iterations) {
+        const int batch = min(batchSize_, iterations - sampled);
+        const int first = sampled;
+        parallelFor(0, batch, [&](const cv::Range& range) {
+            for (int h = range.start; h < range.end; h++) {
+                // seeded with the hypothesis index, the result does not depend on the scheduling
+                cv::RNG rng(0x9e3779b9u + first + h);
+                int sample[4];
+                for (int i = 0; i < 4; i++) {
+                    bool unique;
+                    do {
+                        sample[i] = rng.uniform(0, n);
+                        unique = true;
+                        for (int j = 0; j < i; j++) {
+                            unique = unique && (sample[j] != sample[i]);
+                        }
+                    } while (!unique);
+                }
+
+                inlierCnts[h] = 0;
+                if (solveMinimal(corr, K, distCoeffs, sample, hypotheses[h])) {
+                    inlierCnts[h] = countInliers(corr, model, hypotheses[h]);
+                }
+            }
+        });
+        sampled += batch;
+
+        for (int h = 0; h < batch; h++) {
+            if (inlierCnts[h] > bestCnt) {
+                bestCnt = inlierCnts[h];
+                pose = hypotheses[h];
+            }
+        }
+        // adaptive termination with the best inlier ratio so far
+        iterations = min(iterations, requiredIterations(double(bestCnt) / n));
+    }
+
+    cout << "  PNP RANSAC hypotheses: " << sampled << endl;
+    if (bestCnt < 4) {
+        return 0;
+    }
+
+    const Eigen::Matrix3d R = pose.rotationMatrix();
+    const Vector3d t = pose.translation();
+    int cnt = 0;
+    for (int i = 0; i < n; i++) {
+        Vector3d pc = R * Vector3d(corr.x[i], corr.y[i], corr.z[i]) + t;
+        if (pc[2] <= 0) {
+            continue;
+        }
+        inliers[i] = (Vector2d(corr.u[i], corr.v[i]) - model.project(pc)).squaredNorm() < threshold2_;
+        cnt += inliers[i];
+    }
+    return cnt;
+}
+
+} // namespace
@@ -0,0 +1,152 @@
+#include <Eigen/Cholesky>
+
+#include "myslam/pose_optimizer.h"
+#include "myslam/config.h"
+
+namespace myslam {
+
+typedef Eigen::Matrix<double, 6, 6> Matrix6d;
+typedef Eigen::Matrix<double, 6, 1> Vector6d;
+
+PoseOptimizer::PoseOptimizer()
+{
+    iterations_ = Config::get<int>("pose_optimization_iterations");
+    rounds_ = max(1, Config::get<int>("pose_optimization_rounds"));
+    chi2Th_ = Config::get<double>("pose_optimization_chi2_th");
+    huberDelta_ = sqrt(chi2Th_);
+}
+
+template<class Model>
+double PoseOptimizer::buildNormalEquations(const PoseCorrespondences& corr, const Model& model,
+                                           const SE3& pose, const vector<uchar>& inliers, const bool robust,
+                                           Matrix6d& H, Vector6d& b) const
+{
+    const Eigen::Matrix3d R = pose.rotationMatrix();
+    const Vector3d t = pose.translation();
+    const double delta2 = huberDelta_ * huberDelta_;
+
+    H.setZero();
+    b.setZero();
+    double cost = 0;
+    Eigen::Matrix<double, 2, 6> J;
+    for (size_t i = 0; i < corr.size(); i++) {
+        if (!inliers[i]) {
+            continue;
+        }
+        Vector3d pc = R * Vector3d(corr.x[i], corr.y[i], corr.z[i]) + t;
+        if (pc[2] <= 0) {
+            continue;
+        }
+        Vector2d e = Vector2d(corr.u[i], corr.v[i]) - model.project(pc);
+
+        // jacobian of the error, the opposite of projectPoseJacobian in camera_model.h
+        projectPoseJacobian(model, pc, J);
+        J = -J;
+
+        const double chi2 = e.squaredNorm();
+        double w = 1.0;
+        if (robust && chi2 > delta2) {
+            const double r = sqrt(chi2);
+            w = huberDelta_ / r;
+            cost += 2 * huberDelta_ * r - delta2;
+        } else {
+            cost += chi2;
+        }
+
+        H.noalias() += w * J.transpose() * J;
+        b.noalias() -= w * J.transpose() * e;
+    }
+    return cost;
+}
+
+template<class Model>
+double PoseOptimizer::computeCost(const PoseCorrespondences& corr, const Model& model,
+                                  const SE3& pose, const vector<uchar>& inliers, const bool robust) const
+{
+    const Eigen::Matrix3d R = pose.rotationMatrix();
+    const Vector3d t = pose.translation();
+    const double delta2 = huberDelta_ * huberDelta_;
+
+    double cost = 0;
+    for (size_t i = 0; i < corr.size(); i++) {
+        if (!inliers[i]) {
+            continue;
+        }
+        Vector3d pc = R * Vector3d(corr.x[i], corr.y[i], corr.z[i]) + t;
+        if (pc[2] <= 0) {
+            continue;
+        }
+        const double chi2 = (Vector2d(corr.u[i], corr.v[i]) - model.project(pc)).squaredNorm();
+        cost += (robust && chi2 > delta2) ? 2 * huberDelta_ * sqrt(chi2) - delta2 : chi2;
+    }
+    return cost;
+}
+
+int PoseOptimizer::optimize(const PoseCorrespondences& corr, const Camera::Ptr& camera,
+                            SE3& pose, vector<uchar>& inliers)
+{
+    if (camera->hasDistortion()) {
+        return optimizeWith(corr, camera->getRadialTangential(), pose, inliers);
+    }
+    return optimizeWith(corr, camera->getPinhole(), pose, inliers);
+}
+
+template<class Model>
+int PoseOptimizer::optimizeWith(const PoseCorrespondences& corr, const Model& model,
+                                SE3& pose, vector<uchar>& inliers) const
+{
+    inliers.resize(corr.size(), 1);
+
+    Matrix6d H;
+    Vector6d b;
+    int inlierCnt = 0;
+    for (int round = 0; round < rounds_; round++) {
+        const bool robust = (round < rounds_ - 1);
+
+        // Levenberg-Marquardt on the current inliers
+        double cost = buildNormalEquations(corr, model, pose, inliers, robust, H, b);
+        double lambda = 1e-5 * H.diagonal().maxCoeff();
+        for (int iter = 0; iter < iterations_; iter++) {
+            Matrix6d A = H;
+            A.diagonal().array() += lambda;
+            Vector6d delta = A.ldlt().solve(b);
+            if (!delta.allFinite()) {
+                break;
+            }
+
+            SE3 newPose = SE3::exp(delta) * pose;
+            double newCost = computeCost(corr, model, newPose, inliers, robust);
+            if (newCost < cost) {
+                pose = newPose;
+                lambda = max(lambda * 0.1, 1e-12);
+                if (delta.norm() < 1e-8) {
+                    break;
+                }
+                cost = buildNormalEquations(corr, model, pose, inliers, robust, H, b);
+            } else {
+                lambda *= 10;
+            }
+        }
+
+        // reclassify all the correspondences with the refined pose
+        const Eigen::Matrix3d R = pose.rotationMatrix();
+        const Vector3d t = pose.translation();
+        inlierCnt = 0;
+        for (size_t i = 0; i < corr.size(); i++) {
+            Vector3d pc = R * Vector3d(corr.x[i], corr.y[i], corr.z[i]) + t;
+            bool inlier = false;
+            if (pc[2] > 0) {
+                inlier = (Vector2d(corr.u[i], corr.v[i]) - model.project(pc)).squaredNorm() < chi2Th_;
+            }
+            inliers[i] = inlier;
+            inlierCnt += inlier;
+        }
+
+        if (inlierCnt < 3) {
+            break;
+        }
+    }
+    return inlierCnt;
+}
+
+} // namespace
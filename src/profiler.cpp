@@ -0,0 +1,157 @@
+#include <iomanip>
+
+#include "myslam/profiler.h"
+
+namespace myslam {
+
+static const char* STAGE_NAMES[Profiler::NUM_STAGES] = {
+    "track", "extract", "match", "pnp_ransac", "motion_ba",
+    "culling", "triangulation", "backend_optimize", "viewer_sync",
+    "direct_align", "optical_flow"
+};
+
+static const char* COUNTER_NAMES[Profiler::NUM_COUNTERS] = {
+    "candidates", "matches", "inliers", "new_mappoints", "active_mappoints", "feature_budget"
+};
+
+void Profiler::open(const string& csvFile, const string& traceFile)
+{
+    unique_lock<mutex> lck(profilerMutex_);
+    if (enabled_) {
+        return;
+    }
+
+    csv_.open(csvFile);
+    if (!csv_) {
+        cout << "Cannot open the profile file " << csvFile << endl;
+        return;
+    }
+    csv_ << "frame_id";
+    for (int i = 0; i < NUM_STAGES; i++) {
+        csv_ << ',' << STAGE_NAMES[i] << "_ms";
+    }
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+        csv_ << ',' << COUNTER_NAMES[i];
+    }
+    csv_ << '\n';
+    csv_ << std::fixed << std::setprecision(3);
+
+    if (!traceFile.empty()) {
+        trace_.open(traceFile);
+        if (trace_) {
+            trace_ << "[\n";
+            trace_ << std::fixed << std::setprecision(1);
+        } else {
+            cout << "Cannot open the trace file " << traceFile << endl;
+        }
+    }
+
+    epoch_ = std::chrono::steady_clock::now();
+    enabled_ = true;
+}
+
+void Profiler::close()
+{
+    unique_lock<mutex> lck(profilerMutex_);
+    if (!enabled_) {
+        return;
+    }
+    enabled_ = false;
+
+    for (auto& frame : pendingFrames_) {
+        writeRow(frame.first, frame.second);
+    }
+    pendingFrames_.clear();
+    csv_.close();
+
+    if (trace_.is_open()) {
+        trace_ << "\n]\n";
+        trace_.close();
+    }
+}
+
+void Profiler::beginFrame(const unsigned long frameId)
+{
+    if (!enabled_) {
+        return;
+    }
+    unique_lock<mutex> lck(profilerMutex_);
+    currentFrame_ = max<long>(frameId, lastWritten_ + 1);
+    pendingFrames_[currentFrame_];
+}
+
+void Profiler::endFrame()
+{
+    if (!enabled_) {
+        return;
+    }
+    unique_lock<mutex> lck(profilerMutex_);
+
+    // the rows before the current frame only hold late records, write them in order
+    auto end = pendingFrames_.upper_bound(currentFrame_);
+    for (auto iter = pendingFrames_.begin(); iter != end; iter++) {
+        writeRow(iter->first, iter->second);
+    }
+    pendingFrames_.erase(pendingFrames_.begin(), end);
+    lastWritten_ = currentFrame_;
+}
+
+Profiler::FrameRecord& Profiler::recordOf(const long frameId)
+{
+    long id = (frameId < 0) ? currentFrame_ : frameId;
+    return pendingFrames_[max(id, lastWritten_ + 1)];
+}
+
+void Profiler::addStageTime(const Stage stage, const double startUs, const double durationUs, const long frameId)
+{
+    if (!enabled_) {
+        return;
+    }
+    unique_lock<mutex> lck(profilerMutex_);
+    recordOf(frameId).stageMs[stage] += durationUs / 1000.0;
+
+    if (trace_.is_open()) {
+        auto tid = threadIds_.insert(make_pair(std::this_thread::get_id(), int(threadIds_.size()))).first->second;
+        trace_ << (traceEvents_++ ? ",\n" : "")
+               << "{\"name\":\"" << STAGE_NAMES[stage] << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << tid
+               << ",\"ts\":" << startUs << ",\"dur\":" << durationUs
+               << ",\"args\":{\"frame\":" << ((frameId < 0) ? currentFrame_ : frameId) << "}}";
+    }
+}
+
+void Profiler::setCounter(const Counter counter, const long value)
+{
+    if (!enabled_) {
+        return;
+    }
+    unique_lock<mutex> lck(profilerMutex_);
+    recordOf(-1).counters[counter] = value;
+}
+
+vector<double> Profiler::getStageTimes(const Stage stage)
+{
+    unique_lock<mutex> lck(profilerMutex_);
+    return stageTimes_[stage];
+}
+
+const char* Profiler::getStageName(const Stage stage)
+{
+    return STAGE_NAMES[stage];
+}
+
+void Profiler::writeRow(const long frameId, const FrameRecord& record)
+{
+    csv_ << frameId;
+    for (int i = 0; i < NUM_STAGES; i++) {
+        csv_ << ',' << record.stageMs[i];
+        if (keepStageTimes_ && record.stageMs[i] > 0) {
+            stageTimes_[i].push_back(record.stageMs[i]);
+        }
+    }
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+        csv_ << ',' << record.counters[i];
+    }
+    csv_ << '\n';
+}
+
+} // namespace
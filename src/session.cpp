@@ -0,0 +1,54 @@
+#include "myslam/session.h"
+#include "myslam/config.h"
+
+namespace myslam {
+
+Session::Session(const string& datasetDir, const Camera::Ptr& camera)
+: camera_(camera), frameCount_(0)
+{
+    map_ = Map::Ptr(new Map);
+    frontend_ = FrontEnd::Ptr(new FrontEnd(map_));
+    if (Config::get<int>("enable_local_optimization")) {
+        backend_ = Backend::Ptr(new Backend(map_));
+        backend_->setCamera(camera_);
+        frontend_->setBackend(backend_);
+    }
+    loader_ = FrameLoader::Ptr(new FrameLoader(datasetDir, camera_, map_->getNextFrameId()));
+}
+
+bool Session::run()
+{
+    FeatureExtractor::Ptr extractor = frontend_->getFeatureExtractor();
+    if (Config::get<int>("pipelined_tracking") && frontend_->extractsEveryFrame()) {
+        FrameLoader::Ptr loader = loader_;
+        extractor->start([loader] { return loader->next(); });
+    }
+
+    bool lost = false;
+    while (true) {
+        Frame::Ptr frame = extractor->isPipelined() ? extractor->next() : loader_->next();
+        if (frame == nullptr) {
+            break;
+        }
+        frameCount_++;
+        frontend_->addFrame(frame);
+        if (frontend_->getState() == FrontEnd::LOST) {
+            lost = true;
+            break;
+        }
+    }
+
+    Stop();
+    return !lost;
+}
+
+void Session::Stop()
+{
+    frontend_->getFeatureExtractor()->Stop();
+    loader_->Stop();
+    if (backend_) {
+        backend_->Stop();
+    }
+}
+
+} // namespace
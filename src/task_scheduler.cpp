@@ -0,0 +1,215 @@
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "myslam/task_scheduler.h"
+#include "myslam/config.h"
+
+namespace myslam {
+
+// index of the worker running on this thread, -1 for the other threads
+static thread_local int currentWorker = -1;
+
+struct TaskScheduler::ParallelForState {
+    const RangeTask* func;          // only used by the chunks taken before the last one is done
+    int begin, end, chunks;
+    atomic<int> nextChunk, doneChunks;
+    mutex doneMutex;
+    condition_variable allDone;
+};
+
+TaskScheduler::TaskScheduler()
+: runningBackground_(0), nextWorker_(0), running_(true)
+{
+    const int cores = max(1u, std::thread::hardware_concurrency());
+    // by default, one worker per core besides the frontend thread
+    int threadNum = Config::get<int>("scheduler_threads");
+    if (threadNum <= 0) {
+        threadNum = max(1, cores - 1);
+    }
+    maxBackground_ = max(1, min(Config::get<int>("scheduler_max_background"), threadNum));
+    const bool pinThreads = Config::get<int>("scheduler_pin_threads");
+    const int firstCore = Config::get<int>("scheduler_first_core");
+
+    for (int p = 0; p < NUM_PRIORITIES; p++) {
+        queued_[p] = 0;
+    }
+    for (int i = 0; i < threadNum; i++) {
+        workers_.push_back(unique_ptr<Worker>(new Worker));
+    }
+    for (int i = 0; i < threadNum; i++) {
+        workers_[i]->workerThread = std::thread([this, i, pinThreads, firstCore, cores] {
+            if (pinThreads && !setAffinity((firstCore + i) % cores)) {
+                cout << "Cannot pin the scheduler worker " << i << endl;
+            }
+            workerLoop(i);
+        });
+    }
+    cout << "Task scheduler: " << threadNum << " workers, " << maxBackground_ << " for background tasks" << endl;
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    {
+        unique_lock<mutex> lock(idleMutex_);
+        running_ = false;
+    }
+    taskAvailable_.notify_all();
+    for (auto& worker : workers_) {
+        worker->workerThread.join();
+    }
+}
+
+bool TaskScheduler::setAffinity(const int core)
+{
+#ifdef __linux__
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(core, &cpuset);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset) == 0;
+#else
+    return false;
+#endif
+}
+
+void TaskScheduler::submit(const Task& task, const Priority priority)
+{
+    // the tasks of a worker go to its own deque, they likely share its cache
+    const int index = currentWorker >= 0 ? currentWorker : int(nextWorker_++ % workers_.size());
+    {
+        unique_lock<mutex> lock(workers_[index]->queueMutex);
+        workers_[index]->queues[priority].push_back(task);
+    }
+    queued_[priority]++;
+    // the idle workers check the counters under idleMutex_, so no wake up is lost
+    {
+        unique_lock<mutex> lock(idleMutex_);
+    }
+    taskAvailable_.notify_one();
+}
+
+bool TaskScheduler::hasRunnableTask() const
+{
+    return queued_[PRIORITY_TRACKING] > 0
+        || (queued_[PRIORITY_BACKGROUND] > 0 && runningBackground_ < maxBackground_);
+}
+
+bool TaskScheduler::popTask(const int index, const Priority priority, Task& task)
+{
+    const int n = workers_.size();
+    for (int k = 0; k < n; k++) {
+        Worker& worker = *workers_[(index + k) % n];
+        unique_lock<mutex> lock(worker.queueMutex);
+        std::deque<Task>& queue = worker.queues[priority];
+        if (queue.empty()) {
+            continue;
+        }
+        // newest of its own deque, oldest of the others
+        if (k == 0) {
+            task = std::move(queue.back());
+            queue.pop_back();
+        } else {
+            task = std::move(queue.front());
+            queue.pop_front();
+        }
+        queued_[priority]--;
+        return true;
+    }
+    return false;
+}
+
+bool TaskScheduler::takeTask(const int index, Task& task, Priority& priority)
+{
+    if (queued_[PRIORITY_TRACKING] > 0 && popTask(index, PRIORITY_TRACKING, task)) {
+        priority = PRIORITY_TRACKING;
+        return true;
+    }
+    if (queued_[PRIORITY_BACKGROUND] > 0) {
+        // reserve the background slot before taking the task
+        if (++runningBackground_ <= maxBackground_ && popTask(index, PRIORITY_BACKGROUND, task)) {
+            priority = PRIORITY_BACKGROUND;
+            return true;
+        }
+        runningBackground_--;
+    }
+    return false;
+}
+
+void TaskScheduler::workerLoop(const int index)
+{
+    currentWorker = index;
+    Task task;
+    Priority priority;
+    while (true) {
+        if (!takeTask(index, task, priority)) {
+            unique_lock<mutex> lock(idleMutex_);
+            taskAvailable_.wait(lock, [this] { return hasRunnableTask() || !running_; });
+            if (!running_) {
+                return;
+            }
+            continue;
+        }
+
+        task();
+        task = nullptr;
+        if (priority == PRIORITY_BACKGROUND) {
+            runningBackground_--;
+            // the background tasks queued meanwhile may run now
+            if (queued_[PRIORITY_BACKGROUND] > 0) {
+                {
+                    unique_lock<mutex> lock(idleMutex_);
+                }
+                taskAvailable_.notify_one();
+            }
+        }
+    }
+}
+
+void TaskScheduler::runChunks(ParallelForState& state)
+{
+    const int length = state.end - state.begin;
+    int chunk;
+    while ((chunk = state.nextChunk++) < state.chunks) {
+        const cv::Range range(state.begin + int(long(length) * chunk / state.chunks),
+                              state.begin + int(long(length) * (chunk + 1) / state.chunks));
+        (*state.func)(range);
+        if (++state.doneChunks == state.chunks) {
+            unique_lock<mutex> lock(state.doneMutex);
+            state.allDone.notify_all();
+        }
+    }
+}
+
+void TaskScheduler::parallelFor(const int begin, const int end, const RangeTask& func, const Priority priority)
+{
+    if (end <= begin) {
+        return;
+    }
+    const int workerNum = workers_.size();
+    // a few chunks per thread to balance the uneven ones
+    const int chunks = min(end - begin, 4 * (workerNum + 1));
+    if (chunks == 1) {
+        func(cv::Range(begin, end));
+        return;
+    }
+
+    // the helpers that start late find no chunk left and only release the state
+    shared_ptr<ParallelForState> state = make_shared<ParallelForState>();
+    state->func = &func;
+    state->begin = begin;
+    state->end = end;
+    state->chunks = chunks;
+    state->nextChunk = 0;
+    state->doneChunks = 0;
+    const int helpers = min(chunks - 1, workerNum);
+    for (int i = 0; i < helpers; i++) {
+        submit([state] { runChunks(*state); }, priority);
+    }
+
+    runChunks(*state);
+    unique_lock<mutex> lock(state->doneMutex);
+    state->allDone.wait(lock, [&state] { return state->doneChunks == state->chunks; });
+}
+
+} // namespace
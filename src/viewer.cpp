@@ -1,16 +1,16 @@
 #include "myslam/viewer.h"
 #include <pangolin/pangolin.h>
 #include <opencv2/opencv.hpp>
+#include <chrono>
 
 
 namespace myslam {
 
 
 void Viewer::updateDrawingObjects() {
-    std::unique_lock<std::mutex> lck(viewer_data_mutex_);
-    all_keyframes_ = Map::getInstance().getAllKeyFrames();
-    all_mappoints_ = Map::getInstance().getAllMappoints();
-    active_mappoints_ = Map::getInstance().getActiveMappoints();
+    all_keyframes_ = map_->getAllKeyFrames();
+    all_mappoints_ = map_->getAllMappoints();
+    active_mappoints_ = map_->getActiveMappoints();
 }
 
 void Viewer::ThreadLoop() {
@@ -31,22 +31,37 @@ void Viewer::ThreadLoop() {
 
     const float red[3] = {1.0, 0, 0};
 
+    auto lastUpdate = std::chrono::steady_clock::now() - std::chrono::milliseconds(update_interval_);
     while (!pangolin::ShouldQuit() && viewer_running_) {
+        // refresh the map snapshots at most once per update interval
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastUpdate >= std::chrono::milliseconds(update_interval_)) {
+            updateDrawingObjects();
+            lastUpdate = now;
+        }
+
+        Frame::Ptr current_frame;
+        shared_ptr<const KeyPointSet> keypoints;
+        {
+            unique_lock<mutex> lock(viewer_data_mutex_);
+            current_frame = current_frame_;
+            keypoints = keypointsCurr_;
+        }
+
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         // glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
         vis_display.Activate(vis_camera);
 
-        unique_lock<mutex> lock(viewer_data_mutex_);
-        if (current_frame_) {
-            DrawFrame(current_frame_, red);
-            // FollowCurrentFrame(vis_camera);
+        if (current_frame) {
+            DrawFrame(current_frame, red);
+            // FollowCurrentFrame(current_frame, vis_camera);
 
-            cv::Mat img = PlotFrameImage();
+            cv::Mat img = PlotFrameImage(current_frame, keypoints ? *keypoints : KeyPointSet());
             cv::imshow("image", img);
             cv::waitKey(1);
         }
 
-        // DrawOtherKeyFrames();
+        // DrawOtherKeyFrames(current_frame);
         DrawMapPoints();
 
         pangolin::FinishFrame();
@@ -54,11 +69,14 @@ void Viewer::ThreadLoop() {
     }
 }
 
-void Viewer::DrawOtherKeyFrames() {
+void Viewer::DrawOtherKeyFrames(const Frame::Ptr& current_frame) {
     const float normalColor[3] = {0, 0, 1.0};
 
-    for (auto& kf : all_keyframes_) {
-        if(kf.first == current_frame_->getId())
+    if (!all_keyframes_) {
+        return;
+    }
+    for (auto& kf : *all_keyframes_) {
+        if(current_frame && kf.first == current_frame->getId())
             continue;
 
         DrawFrame(kf.second, normalColor);
@@ -70,10 +88,14 @@ void Viewer::DrawMapPoints() {
     const float normalColor[3] = {0, 1.0, 0};
     const float outliderColor[3] = {1.0, 0, 0};
 
+    if (!all_mappoints_ || !active_mappoints_) {
+        return;
+    }
+
     glPointSize(2);
     glBegin(GL_POINTS);
-    for (auto& mappoint : all_mappoints_) {
-        if (active_mappoints_.count(mappoint.first)) {
+    for (auto& mappoint : *all_mappoints_) {
+        if (active_mappoints_->count(mappoint.first)) {
             glColor3f(activeColor[0], activeColor[1], activeColor[2]);
         }
         else {
@@ -135,15 +157,15 @@ void Viewer::DrawFrame(Frame::Ptr frame, const float* color) {
     glPopMatrix();
 }
 
-void Viewer::FollowCurrentFrame(pangolin::OpenGlRenderState& vis_camera) {
-    SE3 Twc = current_frame_->getPose().inverse();
+void Viewer::FollowCurrentFrame(const Frame::Ptr& current_frame, pangolin::OpenGlRenderState& vis_camera) {
+    SE3 Twc = current_frame->getPose().inverse();
     pangolin::OpenGlMatrix m(Twc.matrix());
     vis_camera.Follow(m, true);
 }
 
-cv::Mat Viewer::PlotFrameImage() {
-    cv::Mat img_out = current_frame_->color_.clone();
-    for(auto& keypoint : keypointsCurr_) {
+cv::Mat Viewer::PlotFrameImage(const Frame::Ptr& current_frame, const KeyPointSet& keypoints) {
+    cv::Mat img_out = current_frame->color_.clone();
+    for(auto& keypoint : keypoints) {
         cv::circle(img_out, keypoint.pt, 2, cv::Scalar(0, 250, 0), 2);
     }
     return img_out;
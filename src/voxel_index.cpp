@@ -0,0 +1,153 @@
+#include "myslam/voxel_index.h"
+
+namespace myslam {
+
+VoxelIndex::VoxelIndex(const double voxelSize, const double maxDepth)
+: voxelSize_(voxelSize), maxDepth_(maxDepth)
+{
+}
+
+VoxelIndex::VoxelKey VoxelIndex::toKey(const Vector3d& pos) const
+{
+    VoxelKey key;
+    key.x = int(floor(pos[0] / voxelSize_));
+    key.y = int(floor(pos[1] / voxelSize_));
+    key.z = int(floor(pos[2] / voxelSize_));
+    return key;
+}
+
+void VoxelIndex::insert(const MapPoint::Ptr& mappoint, const Vector3d& pos)
+{
+    if (pointVoxel_.count(mappoint->getId())) {
+        update(mappoint, pos);
+        return;
+    }
+    VoxelKey key = toKey(pos);
+    voxels_[key].push_back(mappoint);
+    pointVoxel_[mappoint->getId()] = key;
+}
+
+void VoxelIndex::update(const MapPoint::Ptr& mappoint, const Vector3d& pos)
+{
+    auto iter = pointVoxel_.find(mappoint->getId());
+    if (iter == pointVoxel_.end()) {
+        insert(mappoint, pos);
+        return;
+    }
+
+    VoxelKey key = toKey(pos);
+    if (key == iter->second) {
+        return;
+    }
+    removeFromVoxel(iter->second, mappoint->getId());
+    voxels_[key].push_back(mappoint);
+    iter->second = key;
+}
+
+void VoxelIndex::erase(const unsigned long id)
+{
+    auto iter = pointVoxel_.find(id);
+    if (iter == pointVoxel_.end()) {
+        return;
+    }
+    removeFromVoxel(iter->second, id);
+    pointVoxel_.erase(iter);
+}
+
+void VoxelIndex::removeFromVoxel(const VoxelKey& key, const unsigned long id)
+{
+    auto voxel = voxels_.find(key);
+    if (voxel == voxels_.end()) {
+        return;
+    }
+
+    vector<MapPoint::Ptr>& points = voxel->second;
+    for (size_t i = 0; i < points.size(); i++) {
+        if (points[i]->getId() == id) {
+            points[i] = points.back();
+            points.pop_back();
+            break;
+        }
+    }
+    if (points.empty()) {
+        voxels_.erase(voxel);
+    }
+}
+
+void VoxelIndex::queryFrustum(const Frame::Ptr& frame, vector<MapPoint::Ptr>& mappoints) const
+{
+    if (voxels_.empty()) {
+        return;
+    }
+
+    const SE3 T_c_w = frame->getPose();
+    const Camera::Ptr& camera = frame->camera_;
+    const double w = frame->color_.cols, h = frame->color_.rows;
+
+    // bounding box of the frustum: the camera center and the four far corners
+    Vector3d minPos = T_c_w.inverse().translation();
+    Vector3d maxPos = minPos;
+    const double cornerU[4] = {0, w, 0, w};
+    const double cornerV[4] = {0, 0, h, h};
+    for (int i = 0; i < 4; i++) {
+        Vector3d corner = camera->pixel2world(Vector2d(cornerU[i], cornerV[i]), T_c_w, maxDepth_);
+        minPos = minPos.cwiseMin(corner);
+        maxPos = maxPos.cwiseMax(corner);
+    }
+    const VoxelKey lo = toKey(minPos), hi = toKey(maxPos);
+
+    // side planes of the frustum through the camera center, a point is inside when n.dot(p_c) > 0
+    Vector3d normals[4] = {
+        Vector3d(camera->fx_, 0, camera->cx_).normalized(),         // u > 0
+        Vector3d(-camera->fx_, 0, w - camera->cx_).normalized(),    // u < w
+        Vector3d(0, camera->fy_, camera->cy_).normalized(),         // v > 0
+        Vector3d(0, -camera->fy_, h - camera->cy_).normalized()     // v < h
+    };
+    // conservative test of the bounding sphere of a voxel
+    const double radius = voxelSize_ * sqrt(3.0) / 2;
+    auto intersects = [&](const VoxelKey& key) {
+        Vector3d center((key.x + 0.5) * voxelSize_, (key.y + 0.5) * voxelSize_, (key.z + 0.5) * voxelSize_);
+        Vector3d p_c = T_c_w * center;
+        if (p_c[2] < -radius || p_c[2] > maxDepth_ + radius) {
+            return false;
+        }
+        for (int i = 0; i < 4; i++) {
+            if (normals[i].dot(p_c) < -radius) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    // walk the bounding box, or the occupied voxels when there are fewer of them
+    const double boxVoxels = double(hi.x - lo.x + 1) * (hi.y - lo.y + 1) * (hi.z - lo.z + 1);
+    if (boxVoxels <= voxels_.size()) {
+        VoxelKey key;
+        for (key.x = lo.x; key.x <= hi.x; key.x++) {
+            for (key.y = lo.y; key.y <= hi.y; key.y++) {
+                for (key.z = lo.z; key.z <= hi.z; key.z++) {
+                    if (!intersects(key)) {
+                        continue;
+                    }
+                    auto voxel = voxels_.find(key);
+                    if (voxel != voxels_.end()) {
+                        mappoints.insert(mappoints.end(), voxel->second.begin(), voxel->second.end());
+                    }
+                }
+            }
+        }
+    } else {
+        for (auto& voxel : voxels_) {
+            const VoxelKey& key = voxel.first;
+            if (key.x < lo.x || key.y < lo.y || key.z < lo.z
+                || key.x > hi.x || key.y > hi.y || key.z > hi.z
+                || !intersects(key))
+            {
+                continue;
+            }
+            mappoints.insert(mappoints.end(), voxel.second.begin(), voxel.second.end());
+        }
+    }
+}
+
+} // namespace
@@ -0,0 +1,85 @@
+#!/usr/bin/python3
+"""
+Compare a bench_vo report with a baseline report of the same sequence.
+Exit with 1 if the accuracy or the latency regressed beyond the tolerances,
+and with 2 without comparing if the two reports were run with different settings.
+
+usage: compare_bench.py baseline.json current.json [--latency_tolerance 0.1] [--accuracy_tolerance 0.1]
+"""
+
+import sys
+import json
+import argparse
+
+# (path in the report, what is compared), lower is better for all of them
+ACCURACY_KEYS = [
+    ("trajectory_error", "ate_rmse_m"),
+    ("trajectory_error", "rpe_trans_rmse_m"),
+    ("trajectory_error", "rpe_rot_rmse_deg"),
+    ("keyframe_trajectory_error", "ate_rmse_m"),
+]
+
+LATENCY_PERCENTILES = ["p50_ms", "p90_ms"]
+
+
+def lookup(report, *keys):
+    for key in keys:
+        if not isinstance(report, dict) or key not in report:
+            return None
+        report = report[key]
+    return report
+
+
+def compare(name, baseline, current, tolerance):
+    """print one line, return True if current is worse than baseline beyond tolerance"""
+    if baseline is None or current is None:
+        return False
+    regressed = current > baseline * (1 + tolerance) and current - baseline > 1e-6
+    print("%-50s %12.6f %12.6f %+8.1f%% %s" % (name, baseline, current,
+          100.0 * (current - baseline) / baseline if baseline > 0 else 0.0,
+          "REGRESSION" if regressed else ""))
+    return regressed
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="compare a bench_vo report with a baseline")
+    parser.add_argument("baseline", help="baseline report")
+    parser.add_argument("current", help="report to check")
+    parser.add_argument("--latency_tolerance", type=float, default=0.1, help="relative latency increase allowed")
+    parser.add_argument("--accuracy_tolerance", type=float, default=0.1, help="relative error increase allowed")
+    args = parser.parse_args()
+
+    baseline = json.load(open(args.baseline))
+    current = json.load(open(args.current))
+
+    settings = baseline.get("settings", {})
+    current_settings = current.get("settings", {})
+    mismatched = sorted(key for key in set(settings) | set(current_settings)
+                        if settings.get(key) != current_settings.get(key))
+    if mismatched:
+        for key in mismatched:
+            print("settings.%s differs: %s vs %s" % (key, settings.get(key), current_settings.get(key)))
+        print("the reports are not comparable")
+        sys.exit(2)
+
+    regressed = False
+    if current.get("lost") and not baseline.get("lost"):
+        print("tracking lost")
+        regressed = True
+
+    for keys in ACCURACY_KEYS:
+        regressed |= compare(".".join(keys), lookup(baseline, *keys), lookup(current, *keys), args.accuracy_tolerance)
+
+    for stage in sorted(baseline.get("stages", {})):
+        for p in LATENCY_PERCENTILES:
+            regressed |= compare("stages.%s.%s" % (stage, p), lookup(baseline, "stages", stage, p),
+                                 lookup(current, "stages", stage, p), args.latency_tolerance)
+
+    for bench in sorted(baseline.get("micro", {})):
+        for p in LATENCY_PERCENTILES:
+            regressed |= compare("micro.%s.%s" % (bench, p), lookup(baseline, "micro", bench, "latency", p),
+                                 lookup(current, "micro", bench, "latency", p), args.latency_tolerance)
+
+    regressed |= compare("peak_rss_mb", baseline.get("peak_rss_mb"), current.get("peak_rss_mb"), args.latency_tolerance)
+
+    sys.exit(1 if regressed else 0)
@@ -0,0 +1,7 @@
+# run bench_vo from the build directory bin/ on each sequence, one report per sequence
+# usage: sh run_bench.sh PARAMETER_FILE SEQUENCE_DIR...
+PARAMETER_FILE=$1
+shift
+for SEQUENCE in "$@"; do
+    ../bin/bench_vo $PARAMETER_FILE $SEQUENCE ../output/bench_$(basename $SEQUENCE).json || exit 1
+done